@@ -1,6 +1,9 @@
 ﻿#include <vector>
 #include <iostream>
 #include <cmath>
+#include <string>
+#include <cstdlib>
+#include <chrono>
 
 #include "tgaimage.h"
 #include "model.h"
@@ -8,8 +11,19 @@
 #include "our_gl.h"
 #include "phong_shader.h"
 #include "camera.h"
+#include "tile_renderer.h"
+#include "raster_kernel.h"
+#include "depth_buffer.h"
+#include "bench.h"
+#include "vertex_cache.h"
+#include "vertex_kernel.h"
+#include "rasterizer.h"
+#include "gbuffer.h"
+#include "light_grid.h"
+#include "image_writer.h"
+#include "turntable.h"
+#include "mesh_clusters.h"
 
-Model* model = nullptr;
 const int width = 800;
 const int height = 800;
 
@@ -22,7 +36,7 @@ Vec3f light_dir(1, 1, 1);
 // ======================
 // Bounding box
 // ======================
-void compute_model_bounds(Model* model, Vec3f& min, Vec3f& max) {
+void compute_model_bounds(const Model* model, Vec3f& min, Vec3f& max) {
     min = max = model->vert(0);
     for (int i = 1; i < model->nverts(); i++) {
         Vec3f v = model->vert(i);
@@ -38,8 +52,8 @@ public:
     mat<3, 3, float> varying_tri; // координаты вершин в пространстве камеры
     
     Vec4f vertex(int iface, int nthvert) {
-        Vec3f v = model->vert(iface, nthvert);
-        Vec4f gl_Vertex = Projection * ModelView * embed<4>(v, 1.f);
+        Vec3f v = draw->model->vert(iface, nthvert);
+        Vec4f gl_Vertex = draw->mvp() * embed<4>(v, 1.f);
         varying_tri[nthvert] = proj<3>(gl_Vertex / gl_Vertex[3]);
         return gl_Vertex;
     }
@@ -49,16 +63,92 @@ public:
         color = TGAColor(255, 0, 0, 255);
         return false;
     }
+
+    IShader* clone() const { return new DebugShader(*this); }
 };
 
 
+// "-cull back,zero,small", "all" или "none"
+int parse_cull_mode(const std::string& s) {
+    if (s == "none") return CULL_NONE;
+    if (s == "all") return CULL_ALL;
+    int mode = CULL_NONE;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        std::string name = s.substr(start, end - start);
+        if (name == "back") mode |= CULL_BACK;
+        else if (name == "zero") mode |= CULL_ZERO_AREA;
+        else if (name == "small") mode |= CULL_NO_SAMPLES;
+        else std::cerr << "unknown cull mode " << name << std::endl;
+        start = end + 1;
+    }
+    return mode;
+}
+
 int main(int argc, char** argv) {
 
+    // ======================
+    // Arguments: [model.obj] [-threads N] [-tile N] [-simd scalar|sse2|avx2] [-depth zbuffer.tga]
+    //            [-cull back,zero,small|all|none] [-vcache batch|lazy|off] [-deferred] [-prepass] [-hiz]
+    //            [-lights N] [-lightcull tile|off] [-specular powf|table]
+    //            [-turntable N | -path camera.txt] [-prefix name] [-pipeline N] - набор ракурсов, см. turntable.h
+    //            [-clusters on|off]
+    //            [-bench name] - только бенчмарк, см. bench.h
+    // ======================
+    const char* model_file = "obj/sponza.obj";
+    int nthreads = 0;   // 0 - по числу ядер, 1 - без тайлов, как раньше
+    int tile_size = 64; // сторона тайла в пикселях
+    const char* depth_file = nullptr; // отладочный вывод z-буфера
+    const char* bench = nullptr;
+    int cull_mode = CULL_ALL;
+    std::string vcache_mode = "batch"; // вершинный шейдер один раз на вершину модели: пакетно, по запросу или выкл.
+    bool deferred = false; // освещение отдельным проходом по G-буферу
+    bool prepass = false;  // сначала только глубина, потом шейдинг пикселей с равной глубиной
+    bool hiz = false;      // иерархический Z: отбрасывание блоков 8x8 и треугольников до обхода пикселей
+    int nlights = 0;       // случайные точечные источники и прожекторы
+    bool light_culling = true; // источники по тайлам экрана, иначе все на каждый фрагмент
+    SpecularMode specular_mode = SPECULAR_POWF;
+    int turntable_frames = 0;         // N ракурсов по кругу в одном процессе
+    const char* camera_path = nullptr; // или ракурсы из файла
+    const char* frame_prefix = nullptr;
+    int pipeline_frames = 0;          // конвейер кадров: столько кадров в работе одновременно
+    bool use_clusters = true;         // отсечение кластеров граней по пирамиде видимости (BVH)
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-threads" && i + 1 < argc) nthreads = atoi(argv[++i]);
+        else if (arg == "-tile" && i + 1 < argc) tile_size = atoi(argv[++i]);
+        else if (arg == "-depth" && i + 1 < argc) depth_file = argv[++i];
+        else if (arg == "-bench" && i + 1 < argc) bench = argv[++i];
+        else if (arg == "-cull" && i + 1 < argc) cull_mode = parse_cull_mode(argv[++i]);
+        else if (arg == "-vcache" && i + 1 < argc) vcache_mode = argv[++i];
+        else if (arg == "-deferred") deferred = true;
+        else if (arg == "-prepass") prepass = true;
+        else if (arg == "-hiz") hiz = true;
+        else if (arg == "-lights" && i + 1 < argc) nlights = atoi(argv[++i]);
+        else if (arg == "-lightcull" && i + 1 < argc) light_culling = std::string(argv[++i]) != "off";
+        else if (arg == "-turntable" && i + 1 < argc) turntable_frames = atoi(argv[++i]);
+        else if (arg == "-path" && i + 1 < argc) camera_path = argv[++i];
+        else if (arg == "-prefix" && i + 1 < argc) frame_prefix = argv[++i];
+        else if (arg == "-pipeline" && i + 1 < argc) pipeline_frames = atoi(argv[++i]);
+        else if (arg == "-clusters" && i + 1 < argc) use_clusters = std::string(argv[++i]) != "off";
+        else if (arg == "-specular" && i + 1 < argc) specular_mode = std::string(argv[++i]) == "table" ? SPECULAR_TABLE : SPECULAR_POWF;
+        else if (arg == "-simd" && i + 1 < argc) {
+            if (!set_span_kernel(argv[++i]) || !set_vertex_kernel(argv[i]))
+                std::cerr << "SIMD kernel " << argv[i] << " is not supported, using " << span_kernel_name() << std::endl;
+        }
+        else model_file = argv[i];
+    }
+
+    if (bench) return run_benchmark(bench, model_file);
+    if (pipeline_frames > 0 && turntable_frames <= 0 && !camera_path)
+        std::cerr << "-pipeline needs -turntable or -path, ignored" << std::endl;
+
     // ======================
     // Load model
     // ======================
-    model = (argc == 2) ? new Model(argv[1])
-        : new Model("obj/sponza.obj");
+    Model* model = new Model(model_file);
 
     // ======================
     // Model bounds
@@ -73,14 +163,26 @@ int main(int argc, char** argv) {
     std::cout << "Model center: " << model_center << std::endl;
     std::cout << "Model radius: " << model_radius << std::endl;
 
+    // Кластеры по MeshClusters::CLUSTER_SIZE граней и BVH над ними - один раз после загрузки
+    MeshClusters* clusters = nullptr;
+    if (use_clusters) {
+        auto c0 = std::chrono::steady_clock::now();
+        clusters = new MeshClusters(*model);
+        auto c1 = std::chrono::steady_clock::now();
+        std::cout << "Clusters: " << clusters->nclusters() << " of " << MeshClusters::CLUSTER_SIZE << " faces, "
+            << clusters->nnodes() << " BVH nodes, built in " << std::chrono::duration<double, std::milli>(c1 - c0).count()
+            << " ms" << std::endl;
+    }
+
     // ======================
-    // Viewport
+    // Render target
     // ======================
-    viewport(0, 0, width, height);
     light_dir.normalize();
 
     TGAImage image(width, height, TGAImage::RGB);
-    TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
+    DepthBuffer zbuffer(width, height);
+    RenderContext context(width, height, &image, &zbuffer);
+    DrawCall call(context, *model);
 
     image.clear();
     zbuffer.clear();
@@ -122,61 +224,220 @@ int main(int argc, char** argv) {
     std::cout << "Camera distance: " << (eye - center).norm() << std::endl;
 
     Camera camera(eye, center, up);
-    ModelView = camera.get_view_matrix();
+    call.model_view = camera.get_view_matrix();
 
     // ======================
     // Projection
     // ======================
-    projection(-1.0f / camera_distance);
+    call.projection = projection(-1.0f / camera_distance);
+
+    if (turntable_frames > 0 || camera_path) {
+        // Пакетный рендер рисует только прямой проход с направленным светом
+        std::string ignored;
+        if (deferred) ignored += " -deferred";
+        if (prepass) ignored += " -prepass";
+        if (nlights > 0) ignored += " -lights";
+        if (!light_culling) ignored += " -lightcull";
+        if (depth_file) ignored += " -depth";
+        if (pipeline_frames <= 0 && tile_size != 64) ignored += " -tile (only with -pipeline)";
+        if (!ignored.empty()) std::cerr << "not supported with -turntable or -path, ignored:" << ignored << std::endl;
+        TurntableOptions opt = { turntable_frames, camera_path, frame_prefix, nthreads, pipeline_frames, tile_size,
+            cull_mode, vcache_mode != "off", hiz, specular_mode, clusters };
+        int code = run_turntable(opt, *model, camera, call.projection, light_dir, width, height);
+        delete clusters;
+        delete model;
+        return code;
+    }
 
     // ======================
     // Shader
     // ======================
-    PhongShader shader;
-    shader.uniform_M = Projection * ModelView;
-    shader.uniform_MIT = (Projection * ModelView).invert_transpose();
-
-    shader.light_dir = light_dir;
-    shader.light_color = Vec3f(1.0f, 1.0f, 1.0f);
-    shader.ambient_color = Vec3f(0.1f, 0.1f, 0.1f);
-
-    shader.specular_exponent = 32.0f;
-    shader.specular_intensity = 0.5f;
-
-    shader.view_dir = (center - eye).normalize();
-    shader.camera_pos = eye;
-
-    shader.diffusemap = &model->diffusemap_;
-    shader.normalmap = &model->normalmap_;
-    shader.specularmap = &model->specularmap_;
+    // Тип шейдера известен на этапе компиляции: fragment() встраивается в растеризатор
+    // (triangle<Shader>, TileRenderer::flush<Shader>). Карты отключены
+    const unsigned scene_features = 0;
+    typedef PhongShaderT<scene_features> SceneShader;
+    SceneShader shader;
+    shader.setup_scene(call, eye, center, light_dir);
+    shader.specular_mode = specular_mode;
+    if (scene_features) model->textures().wait(); // карты грузятся в фоне, геометрия уже готова
+
+    // Локальные источники - в пространстве освещения шейдера, в рамке модели после проекции
+    std::vector<Light> lights;
+    LightGrid light_grid(width, height);
+    if (nlights > 0) {
+        Vec3f lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f);
+        for (int c = 0; c < 8; c++) {
+            Vec3f corner(c & 1 ? model_max.x : model_min.x, c & 2 ? model_max.y : model_min.y, c & 4 ? model_max.z : model_min.z);
+            Vec4f clip = shader.uniform_M * embed<4>(corner, 1.f);
+            Vec3f p = proj<3>(clip / clip[3]);
+            for (int j = 0; j < 3; j++) {
+                lo[j] = std::min(lo[j], p[j]);
+                hi[j] = std::max(hi[j], p[j]);
+            }
+        }
+        lights = make_lights(nlights, lo, hi, 0.2f * std::max(hi.x - lo.x, hi.y - lo.y));
+        shader.lights = &lights;
+        if (light_culling) shader.light_grid = &light_grid;
+    }
+    shader.prepare();
 
     // ======================
     // Render
     // ======================
     int rendered_faces = 0;
-
-    for (int i = 0; i < model->nfaces(); i++) {
-        Vec4f clip_coords[3];
-
+    int culled[CULL_RESULT_COUNT] = { 0 };
+    std::cout << "Raster kernel: " << span_kernel_name() << ", vertex kernel: " << vertex_kernel_name() << std::endl;
+
+    // Кластеры вне экрана отбрасываются до вершинного шейдера
+    std::vector<unsigned char> visible;
+    MeshClusters::CullStats cluster_stats = { 0, 0, 0, 0 };
+    if (clusters) cluster_stats = clusters->cull(context.viewport * call.mvp(), width, height, visible);
+
+    VertexCache* vcache = vcache_mode != "off" && shader.varying_size() > 0 ? new VertexCache(*model, shader) : nullptr;
+    // Пакетом - все вершины модели; если видна меньшая часть граней, дешевле считать
+    // вершины видимых граней по запросу
+    bool vbatch = vcache && vcache_mode == "batch" && (!clusters || 2 * cluster_stats.faces > model->nfaces());
+    auto shade_face = [&](int i, Vec4f* clip_coords) {
+        if (vcache) {
+            vcache->fetch_face(shader, i, clip_coords);
+            return;
+        }
         for (int j = 0; j < 3; j++) {
             clip_coords[j] = shader.vertex(i, j);
         }
+    };
+
+    // Отложенный режим: растеризация пишет только G-буфер, освещение - один раз на пиксель
+    GBuffer* gbuffer = deferred ? new GBuffer(width, height) : nullptr;
+    long long lit_pixels = 0;
+    DepthBuffer& depth = gbuffer ? gbuffer->depth() : zbuffer;
+    depth.enable_hiz(hiz);
+    long long prepass_fragments = 0;
+
+    if (nthreads == 1) {
+        ThreadPool serial(1);
+        // Без G-буфера источники раскладываются по тайлам до кадра, только по x и y
+        if (shader.light_grid && !gbuffer) light_grid.build(lights, context.viewport, serial);
+        if (vbatch) vcache->transform_all(shader, serial);
+        std::vector<int> kept_faces;    // треугольники для второго прохода
+        std::vector<Vec4f> kept_coords; // и их вершины, по 3 на треугольник
+        for (int i = 0; i < model->nfaces(); i++) {
+            if (clusters && !visible[i]) continue; // кластер вне экрана, вершины не считаются
+            Vec4f clip_coords[3];
+            shade_face(i, clip_coords);
+
+            CullResult cull = cull_triangle(clip_coords, width, height, cull_mode);
+            culled[cull]++;
+            if (cull != CULL_KEEP) continue;
+            rendered_faces++;
+
+            if (prepass) {
+                depth_triangle(clip_coords, depth);
+                kept_faces.push_back(i);
+                kept_coords.insert(kept_coords.end(), clip_coords, clip_coords + 3);
+                continue;
+            }
+            if (gbuffer) gbuffer_triangle(clip_coords, shader, *gbuffer);
+            else triangle<SceneShader>(clip_coords, shader, context);
+        }
+        if (prepass) {
+            depth.hiz_build();
+            prepass_fragments = depth.stats().fragments;
+            depth.reset_stats();
+            for (size_t k = 0; k < kept_faces.size(); k++) {
+                // varying-и треугольника: из кэша вершин или повторным vertex()
+                if (vcache) vcache->restore_face(shader, kept_faces[k]);
+                else for (int j = 0; j < 3; j++) shader.vertex(kept_faces[k], j);
+                Vec4f* clip_coords = &kept_coords[3 * k];
+                if (gbuffer) gbuffer_triangle(clip_coords, shader, *gbuffer);
+                else triangle<SceneShader>(clip_coords, shader, context);
+            }
+        }
+        if (gbuffer) {
+            if (shader.light_grid) light_grid.build(lights, context.viewport, serial, gbuffer);
+            lit_pixels = resolve_gbuffer<scene_features>(shader, *gbuffer, image, serial);
+        }
+    }
+    else {
+        // Тайловый режим: сначала раскладываем треугольники по тайлам,
+        // затем тайлы растеризуются параллельно
+        TileRenderer tiles(width, height, tile_size, nthreads);
+        if (shader.light_grid && !gbuffer) light_grid.build(lights, context.viewport, tiles.thread_pool());
+        if (vbatch) vcache->transform_all(shader, tiles.thread_pool());
+        for (int i = 0; i < model->nfaces(); i++) {
+            if (clusters && !visible[i]) continue; // кластер вне экрана, вершины не считаются
+            Vec4f clip_coords[3];
+            shade_face(i, clip_coords);
+
+            CullResult cull = cull_triangle(clip_coords, width, height, cull_mode);
+            culled[cull]++;
+            if (cull != CULL_KEEP) continue;
+
+            tiles.bin(i, clip_coords);
+            rendered_faces++;
+        }
+        if (prepass) {
+            tiles.flush_depth(depth);
+            prepass_fragments = depth.stats().fragments;
+            depth.reset_stats();
+        }
+        if (gbuffer) {
+            tiles.flush_gbuffer<SceneShader>(shader, *gbuffer, vcache);
+            if (shader.light_grid) light_grid.build(lights, context.viewport, tiles.thread_pool(), gbuffer);
+            lit_pixels = resolve_gbuffer<scene_features>(shader, *gbuffer, image, tiles.thread_pool());
+        }
+        else tiles.flush<SceneShader>(shader, image, zbuffer, vcache);
 
-        triangle(clip_coords, shader, image, zbuffer);
-        rendered_faces++;
+        std::cout << "Tiles: " << tiles.ntiles() << " (" << tile_size << "x" << tile_size
+            << "), threads: " << tiles.nthreads() << std::endl;
     }
 
     std::cout << "Rendered faces: "
         << rendered_faces << " / "
         << model->nfaces() << std::endl;
+    if (clusters) {
+        std::cout << "Clusters: tested " << cluster_stats.tested << " boxes, culled " << cluster_stats.culled << " / "
+            << clusters->nclusters() << ", faces skipped " << model->nfaces() - cluster_stats.faces
+            << (vcache && vcache_mode == "batch" && !vbatch ? ", vertices on demand" : "") << std::endl;
+    }
+    std::cout << "Culled: outside " << culled[CULLED_OUTSIDE]
+        << ", back-face " << culled[CULLED_BACKFACE]
+        << ", zero area " << culled[CULLED_ZERO_AREA]
+        << ", no samples " << culled[CULLED_NO_SAMPLES] << std::endl;
+    if (vcache) {
+        std::cout << "Vertex cache: " << vcache->lookups() << " lookups, hit rate " << vcache->hit_rate() * 100
+            << "%, vertex shader calls " << vcache->transformed() << std::endl;
+    }
+    if (nlights > 0) {
+        std::cout << "Lights: " << nlights;
+        if (shader.light_grid) std::cout << ", " << (double)light_grid.references() / light_grid.ntiles() << " per tile "
+            << LightGrid::TILE << "x" << LightGrid::TILE;
+        std::cout << std::endl;
+    }
+    if (prepass) std::cout << "Depth pre-pass: " << prepass_fragments << " fragments" << std::endl;
+    std::cout << "Shaded fragments: " << depth.stats().fragments;
+    if (hiz) std::cout << ", Hi-Z rejected " << depth.stats().hiz_triangles << " triangles, "
+        << depth.stats().hiz_blocks << " blocks 8x8";
+    std::cout << std::endl;
+    if (gbuffer) {
+        // Прямой рендер освещал бы каждый фрагмент, прошедший тест глубины
+        std::cout << "Deferred: " << gbuffer->fragments() << " G-buffer fragments, " << lit_pixels
+            << " pixels lit, overdraw " << (lit_pixels ? (double)gbuffer->fragments() / lit_pixels : 0.)
+            << "x, lighting runs saved " << gbuffer->fragments() - lit_pixels << std::endl;
+    }
 
     // ======================
     // Save
     // ======================
-    image.flip_vertically();
-    zbuffer.flip_vertically();
-    image.write_tga_file("output.tga");
-
+    // Кодирование и запись идут в фоновом потоке, карта глубины готовится параллельно
+    ImageWriter writer;
+    writer.write(std::move(image), "output.tga", true, true);
+    if (depth_file) writer.write((gbuffer ? gbuffer->depth() : zbuffer).to_tga(), depth_file, true, true);
+    writer.wait();
+
+    delete gbuffer;
+    delete vcache;
+    delete clusters;
     delete model;
     return 0;
 }
@@ -0,0 +1,739 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#include "bench.h"
+#include "our_gl.h"
+#include "depth_buffer.h"
+#include "vertex_kernel.h"
+#include "thread_pool.h"
+#include "model.h"
+#include "phong_shader.h"
+#include "vertex_cache.h"
+#include "rasterizer.h"
+#include "gbuffer.h"
+#include "light_grid.h"
+#include "texture.h"
+
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// ======================
+//   ( Linux,    )
+// ======================
+class PerfCounters {
+public:
+    PerfCounters() {
+#ifdef __linux__
+        fd[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        fd[1] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+        fd[0] = fd[1] = -1;
+#endif
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < 2; i++) if (fd[i] >= 0) close(fd[i]);
+#endif
+    }
+    void start() {
+#ifdef __linux__
+        for (int i = 0; i < 2; i++) {
+            if (fd[i] < 0) continue;
+            ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    // -1,   
+    void stop(long long& cache_misses, long long& tlb_misses) {
+        long long v[2] = { -1, -1 };
+#ifdef __linux__
+        for (int i = 0; i < 2; i++) {
+            if (fd[i] < 0) continue;
+            ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd[i], &v[i], sizeof(v[i])) != sizeof(v[i])) v[i] = -1;
+        }
+#endif
+        cache_misses = v[0];
+        tlb_misses = v[1];
+    }
+
+private:
+#ifdef __linux__
+    static int open_counter(unsigned type, unsigned long long config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+    int fd[2];
+};
+
+// ======================
+//  
+// ======================
+struct ConstShader : public IShader {
+    Vec4f vertex(int, int) { return Vec4f(); }
+    bool fragment(Vec3f bar, TGAColor& color) final {
+        color = TGAColor(255, 255, 255, 255);
+        return false;
+    }
+    IShader* clone() const { return new ConstShader(*this); }
+};
+
+//      :    
+static std::vector<Vec4f> make_triangles(int ntris, int width, int height) {
+    std::vector<Vec4f> pts;
+    unsigned seed = 12345;
+    auto rnd = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / float(1 << 24);
+    };
+    for (int t = 0; t < ntris; t++) {
+        float cx = rnd(), cy = rnd(), z = rnd();
+        for (int j = 0; j < 3; j++) {
+            float x = cx + (rnd() - 0.5f) * 0.3f;
+            float y = cy + (rnd() - 0.5f) * 0.3f;
+            pts.push_back(Vec4f());
+            Vec4f& p = pts.back();
+            p[0] = x * width;
+            p[1] = y * height;
+            p[2] = z;
+            p[3] = 1.f;
+        }
+    }
+    return pts;
+}
+
+//  : x , y ,  
+//    , get/set   
+static void legacy_triangle(Vec4f* pts, IShader& shader, TGAImage& image, DepthBuffer& zbuffer) {
+    Vec2f v[3];
+    for (int i = 0; i < 3; i++) v[i] = Vec2f(pts[i][0] / pts[i][3], pts[i][1] / pts[i][3]);
+    Vec2f bboxmin(image.get_width() - 1.f, image.get_height() - 1.f), bboxmax(0.f, 0.f);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            bboxmin[j] = std::max(0.f, std::min(bboxmin[j], v[i][j]));
+            bboxmax[j] = std::min(j ? image.get_height() - 1.f : image.get_width() - 1.f, std::max(bboxmax[j], v[i][j]));
+        }
+    }
+    TGAColor color;
+    for (int x = (int)bboxmin.x; x <= (int)bboxmax.x; x++) {
+        for (int y = (int)bboxmin.y; y <= (int)bboxmax.y; y++) {
+            Vec3f u = cross(Vec3f(v[2].x - v[0].x, v[1].x - v[0].x, v[0].x - x),
+                Vec3f(v[2].y - v[0].y, v[1].y - v[0].y, v[0].y - y));
+            if (std::abs(u.z) < 1e-2) continue;
+            Vec3f c(1.f - (u.x + u.y) / u.z, u.y / u.z, u.x / u.z);
+            if (c.x < 0 || c.y < 0 || c.z < 0) continue;
+            float depth = (pts[0][2] * c.x + pts[1][2] * c.y + pts[2][2] * c.z) /
+                (pts[0][3] * c.x + pts[1][3] * c.y + pts[2][3] * c.z);
+            if (zbuffer.get(x, y) <= depth && !shader.fragment(c, color)) {
+                zbuffer.set(x, y, depth);
+                image.set(x, y, color);
+            }
+        }
+    }
+}
+
+static void print_counter(long long v) {
+    if (v < 0) std::cout << std::setw(14) << "n/a";
+    else std::cout << std::setw(14) << v;
+}
+
+// ======================
+// traversal
+// ======================
+static int bench_traversal() {
+    struct Resolution { const char* name; int w, h; };
+    const Resolution res[] = { { "800x800", 800, 800 }, { "4K", 3840, 2160 }, { "8K", 7680, 4320 } };
+    const int ntris = 200;
+
+    ConstShader shader;
+    PerfCounters counters;
+    std::cout << std::left << std::setw(10) << "size" << std::setw(12) << "traversal" << std::right
+        << std::setw(10) << "ms" << std::setw(14) << "cache-miss" << std::setw(14) << "dTLB-miss" << std::endl;
+
+    for (const Resolution& r : res) {
+        std::vector<Vec4f> pts = make_triangles(ntris, r.w, r.h);
+        TGAImage image(r.w, r.h, TGAImage::RGB);
+        DepthBuffer zbuffer(r.w, r.h);
+
+        for (int mode = 0; mode < 2; mode++) {
+            image.clear();
+            zbuffer.clear();
+            counters.start();
+            auto t0 = std::chrono::steady_clock::now();
+            for (int t = 0; t < ntris; t++) {
+                if (mode == 0) legacy_triangle(&pts[t * 3], shader, image, zbuffer);
+                else triangle(&pts[t * 3], shader, image, zbuffer);
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            long long cache_misses, tlb_misses;
+            counters.stop(cache_misses, tlb_misses);
+
+            std::cout << std::left << std::setw(10) << r.name << std::setw(12) << (mode ? "row-major" : "column") << std::right
+                << std::setw(10) << std::fixed << std::setprecision(1)
+                << std::chrono::duration<double, std::milli>(t1 - t0).count();
+            print_counter(cache_misses);
+            print_counter(tlb_misses);
+            std::cout << std::endl;
+        }
+    }
+    return 0;
+}
+
+// ======================
+// vertex
+// ======================
+//       
+template <class V> static float max_diff(const std::vector<V>& a, const std::vector<V>& b, int dim) {
+    float d = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int k = 0; k < dim; k++) d = std::max(d, std::abs(a[i][k] - b[i][k]));
+    return d;
+}
+
+static int bench_vertex() {
+    const int nverts = 2500000; //       5M 
+    unsigned seed = 12345;
+    auto rnd = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / float(1 << 24) * 2.f - 1.f;
+    };
+    std::vector<Vec3f> positions(nverts), normals(nverts);
+    for (int i = 0; i < nverts; i++) {
+        positions[i] = Vec3f(rnd(), rnd(), rnd());
+        normals[i] = Vec3f(rnd(), rnd(), rnd()).normalize();
+    }
+
+    Matrix Viewport = viewport(0, 0, 800, 800);
+    Matrix ModelView = lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+    Matrix Projection = projection(-1.f / 3.f);
+    VertexTransform xf = { Projection * ModelView, Viewport, (Projection * ModelView).invert_transpose() };
+
+    std::vector<Vec4f> screen(nverts), ref_screen(nverts);
+    std::vector<Vec3f> ndc(nverts), nrm(nverts), ref_ndc(nverts), ref_nrm(nverts);
+
+    std::cout << std::left << std::setw(22) << "vertex stage" << std::right << std::setw(10) << "ms"
+        << std::setw(12) << "Mvert/s" << std::setw(12) << "max diff" << std::endl;
+    auto report = [&](const std::string& name, double ms, float diff) {
+        std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << ms << std::setw(12) << nverts / ms / 1000.;
+        if (diff < 0) std::cout << std::setw(12) << "-";
+        else std::cout << std::setw(12) << std::scientific << std::setprecision(1) << diff;
+        std::cout << std::endl;
+    };
+
+    //  :  ,  Projection * ModelView   
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nverts; i++) {
+        Vec4f clip = Projection * ModelView * embed<4>(positions[i], 1.f);
+        ref_screen[i] = Viewport * clip;
+        ref_ndc[i] = proj<3>(clip / clip[3]);
+        ref_nrm[i] = proj<3>(xf.normal * embed<4>(normals[i], 0.f));
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    report("per-vertex", std::chrono::duration<double, std::milli>(t1 - t0).count(), -1.f);
+
+    const char* kernels[] = { "scalar", "sse2", "avx2" };
+    for (const char* k : kernels) {
+        if (!set_vertex_kernel(k)) continue;
+        t0 = std::chrono::steady_clock::now();
+        transform_vertices(xf, positions.data(), normals.data(), nverts, screen.data(), ndc.data(), nrm.data());
+        t1 = std::chrono::steady_clock::now();
+        float diff = std::max(max_diff(screen, ref_screen, 4), std::max(max_diff(ndc, ref_ndc, 3), max_diff(nrm, ref_nrm, 3)));
+        report(std::string("batch ") + k, std::chrono::duration<double, std::milli>(t1 - t0).count(), diff);
+    }
+    set_vertex_kernel("auto");
+
+    ThreadPool pool;
+    const int CHUNK = 4096;
+    t0 = std::chrono::steady_clock::now();
+    pool.parallel_for((nverts + CHUNK - 1) / CHUNK, [&](int, int chunk) {
+        int begin = chunk * CHUNK;
+        int n = std::min(CHUNK, nverts - begin);
+        transform_vertices(xf, &positions[begin], &normals[begin], n, &screen[begin], &ndc[begin], &nrm[begin]);
+    });
+    t1 = std::chrono::steady_clock::now();
+    float diff = std::max(max_diff(screen, ref_screen, 4), std::max(max_diff(ndc, ref_ndc, 3), max_diff(nrm, ref_nrm, 3)));
+    report(std::string("batch ") + vertex_kernel_name() + " x" + std::to_string(pool.size()),
+        std::chrono::duration<double, std::milli>(t1 - t0).count(), diff);
+    return 0;
+}
+
+// ======================
+// shader
+// ======================
+//  call.model    ,   main();    call
+static void setup_phong(DrawCall& call, PhongShader& shader) {
+    const Model* model = call.model;
+    Vec3f vmin = model->vert(0), vmax = model->vert(0);
+    for (int i = 1; i < model->nverts(); i++)
+        for (int j = 0; j < 3; j++) {
+            vmin[j] = std::min(vmin[j], model->vert(i)[j]);
+            vmax[j] = std::max(vmax[j], model->vert(i)[j]);
+        }
+    Vec3f center = (vmin + vmax) * 0.5f;
+    float radius = (vmax - vmin).norm() * 0.5f;
+    float distance = radius / std::tan(30.f * 3.14159265f / 180.f) * 1.2f;
+    Vec3f eye = center + Vec3f(0, radius * 0.2f, distance);
+
+    call.model_view = lookat(eye, center, Vec3f(0, 1, 0));
+    call.projection = projection(-1.f / distance);
+    shader.setup_scene(call, eye, center, Vec3f(1, 1, 1).normalize());
+    model->textures().wait();
+    shader.prepare();
+}
+
+//  :  ,    triangle<Draw>()
+template <class Draw, class Shader> static double render_frame(Shader& shader, VertexCache& vcache, TGAImage& image, DepthBuffer& zbuffer) {
+    ThreadPool serial(1);
+    image.clear();
+    zbuffer.clear();
+    auto t0 = std::chrono::steady_clock::now();
+    vcache.clear();
+    vcache.transform_all(shader, serial);
+    for (int i = 0; i < shader.draw->model->nfaces(); i++) {
+        Vec4f pts[3];
+        vcache.fetch_face(shader, i, pts);
+        if (cull_triangle(pts, image.get_width(), image.get_height(), CULL_ALL) != CULL_KEEP) continue;
+        triangle<Draw>(pts, shader, image, zbuffer);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+template <unsigned Features> static void bench_phong(const char* name, int frames, const Model& model) {
+    const int width = 800, height = 800;
+    RenderContext context(width, height);
+    DrawCall call(context, model);
+    PhongShaderT<Features> shader;
+    setup_phong(call, shader);
+    VertexCache vcache(model, shader);
+    TGAImage image[2] = { TGAImage(width, height, TGAImage::RGB), TGAImage(width, height, TGAImage::RGB) };
+    DepthBuffer zbuffer(width, height);
+
+    double ms[2] = { 1e30, 1e30 }; //    frames
+    for (int f = 0; f < frames; f++) {
+        ms[0] = std::min(ms[0], render_frame<IShader>(shader, vcache, image[0], zbuffer));
+        ms[1] = std::min(ms[1], render_frame<PhongShaderT<Features> >(shader, vcache, image[1], zbuffer));
+    }
+    size_t bytes = (size_t)width * height * image[0].get_bytespp();
+    bool same = memcmp(image[0].buffer(), image[1].buffer(), bytes) == 0;
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << ms[0] << std::setw(12) << ms[1] << std::setw(10) << std::setprecision(2) << ms[0] / ms[1] << "x"
+        << std::setw(12) << (same ? "same" : "DIFFERENT") << std::endl;
+}
+
+static int bench_shader(const char* model_file) {
+    Model* model = new Model(model_file);
+    if (model->nfaces() == 0) {
+        std::cerr << "can't load " << model_file << std::endl;
+        delete model;
+        return 1;
+    }
+    const int frames = 5;
+    std::cout << std::left << std::setw(12) << "features" << std::right << std::setw(12) << "virtual ms"
+        << std::setw(12) << "template ms" << std::setw(11) << "speedup" << std::setw(12) << "image" << std::endl;
+    //   fragment():      
+    {
+        const int w = 800, h = 800, ntris = 2000;
+        std::vector<Vec4f> pts = make_triangles(ntris, w, h);
+        ConstShader shader;
+        TGAImage image(w, h, TGAImage::RGB);
+        DepthBuffer zbuffer(w, h);
+        double ms[2] = { 1e30, 1e30 };
+        for (int f = 0; f < frames; f++) {
+            for (int mode = 0; mode < 2; mode++) {
+                zbuffer.clear();
+                auto t0 = std::chrono::steady_clock::now();
+                for (int t = 0; t < ntris; t++) {
+                    if (mode == 0) triangle<IShader>(&pts[t * 3], shader, image, zbuffer);
+                    else triangle<ConstShader>(&pts[t * 3], shader, image, zbuffer);
+                }
+                auto t1 = std::chrono::steady_clock::now();
+                ms[mode] = std::min(ms[mode], std::chrono::duration<double, std::milli>(t1 - t0).count());
+            }
+        }
+        std::cout << std::left << std::setw(12) << "const" << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << ms[0] << std::setw(12) << ms[1] << std::setw(10) << std::setprecision(2) << ms[0] / ms[1] << "x"
+            << std::setw(12) << "-" << std::endl;
+    }
+    bench_phong<0>("none", frames, *model);
+    bench_phong<PHONG_DIFFUSE_MAP | PHONG_NORMAL_MAP | PHONG_SPECULAR_MAP>("all maps", frames, *model);
+    delete model;
+    return 0;
+}
+
+// ======================
+// texture
+// ======================
+static int bench_texture() {
+    //  4x4   :       
+    const int size = 1024;
+    TGAImage img(size, size, TGAImage::RGB);
+    unsigned seed = 12345;
+    auto rnd = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (int)(seed >> 24);
+    };
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            int v = ((x / 4 + y / 4) & 1) ? 200 : 40;
+            img.set(x, y, TGAColor((unsigned char)std::min(255, v + rnd() % 32), (unsigned char)v, (unsigned char)(255 - v)));
+        }
+    Texture tex;
+    tex.build(img);
+
+    //  512x512     scale   ;   -
+    //     (16x16   ).  -   ,   1
+    const int screen = 512, sub = 16;
+    std::cout << std::left << std::setw(8) << "scale" << std::setw(12) << "sampler" << std::right << std::setw(10) << "ms"
+        << std::setw(12) << "ns/sample" << std::setw(12) << "error" << std::endl;
+    const float scales[] = { 0.7f, 1.3f, 2.7f, 5.3f, 10.6f };
+    for (float scale : scales) {
+        const int n = screen;
+        float footprint = scale / size;
+        std::vector<Vec3f> ref(n * n);
+        for (int py = 0; py < n; py++)
+            for (int px = 0; px < n; px++) {
+                Vec3f sum(0, 0, 0);
+                for (int dy = 0; dy < sub; dy++)
+                    for (int dx = 0; dx < sub; dx++) {
+                        int tx = (int)((px + (dx + 0.5f) / sub) * scale) % size;
+                        int ty = (int)((py + (dy + 0.5f) / sub) * scale) % size;
+                        TGAColor c = img.get(tx, ty);
+                        sum = sum + Vec3f(c.bgra[2], c.bgra[1], c.bgra[0]) * (1.f / 255.f);
+                    }
+                ref[px + py * n] = sum / (float)(sub * sub);
+            }
+
+        const char* names[] = { "TGAImage", "nearest", "bilinear", "trilinear" };
+        for (int mode = 0; mode < 4; mode++) {
+            std::vector<Vec3f> out(n * n);
+            double best = 1e30;
+            for (int f = 0; f < 3; f++) {
+                auto t0 = std::chrono::steady_clock::now();
+                for (int py = 0; py < n; py++)
+                    for (int px = 0; px < n; px++) {
+                        //   
+                        Vec2f uv((px + 0.5f) * footprint, (py + 0.5f) * footprint);
+                        Vec3f& c = out[px + py * n];
+                        if (mode == 0) {
+                            //   PhongShader: get()   TGAColor
+                            TGAColor t = img.get((int)(uv.x * size) % size, (int)(uv.y * size) % size);
+                            c = Vec3f(t.bgra[2], t.bgra[1], t.bgra[0]) * (1.f / 255.f);
+                        }
+                        else c = tex.sample(uv, tex.lod(footprint), (TextureFilter)(mode - 1));
+                    }
+                auto t1 = std::chrono::steady_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+            }
+            double err = 0;
+            for (int i = 0; i < n * n; i++)
+                for (int k = 0; k < 3; k++) err += std::abs(out[i][k] - ref[i][k]);
+            err /= 3. * n * n;
+            std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(8) << scale << std::setw(12) << names[mode] << std::right << std::fixed
+                << std::setprecision(2) << std::setw(10) << best << std::setw(12) << best * 1e6 / (n * n)
+                << std::setw(12) << std::setprecision(4) << err << std::endl;
+        }
+    }
+    return 0;
+}
+
+// ======================
+// fragment
+// ======================
+//  PhongShader::fragment()  : light_dir    ,
+// uv,       ,   powf
+static TGAColor legacy_fragment(const PhongShader& sh, Vec3f bar) {
+    Vec2f uv(0, 0);
+    Vec3f n(0, 0, 0), p(0, 0, 0);
+    for (int i = 0; i < 3; i++) {
+        uv.x += sh.varying[i][0] * bar[i];
+        uv.y += sh.varying[i][1] * bar[i];
+    }
+    for (int i = 0; i < 3; i++)
+        for (int k = 0; k < 3; k++) n[k] += sh.varying[i][2 + k] * bar[i];
+    n = n.normalize();
+    for (int i = 0; i < 3; i++)
+        for (int k = 0; k < 3; k++) p[k] += sh.varying[i][5 + k] * bar[i];
+
+    Vec3f l = Vec3f(sh.light_dir).normalize();
+    Vec3f to_camera = (sh.camera_pos - p).normalize();
+    float diff = std::max(0.0f, n * l);
+    float spec = 0.0f;
+    if (diff > 0) {
+        Vec3f half_vector = (l + to_camera).normalize();
+        spec = powf(std::max(0.0f, n * half_vector), sh.specular_exponent);
+    }
+    spec *= sh.specular_intensity;
+    Vec3f c;
+    for (int i = 0; i < 3; i++) {
+        c[i] = 0.8f * sh.ambient_color[i] + 0.8f * sh.light_color[i] * diff + sh.light_color[i] * spec;
+        c[i] = std::min(1.0f, std::max(0.0f, c[i]));
+    }
+    return TGAColor((unsigned char)(c[0] * 255), (unsigned char)(c[1] * 255), (unsigned char)(c[2] * 255), 255);
+}
+
+static int bench_fragment(const char* model_file) {
+    Model* model = new Model(model_file);
+    if (model->nfaces() == 0) {
+        std::cerr << "can't load " << model_file << std::endl;
+        delete model;
+        return 1;
+    }
+    const int width = 800, height = 800, frames = 5, per_face = 32;
+    RenderContext context(width, height);
+    DrawCall call(context, *model);
+    PhongShaderT<0> shader;
+    setup_phong(call, shader);
+    VertexCache vcache(*model, shader);
+    ThreadPool pool(1);
+    vcache.transform_all(shader, pool);
+
+    //        
+    std::vector<int> faces;
+    for (int i = 0; i < model->nfaces(); i++) {
+        Vec4f pts[3];
+        vcache.fetch_face(shader, i, pts);
+        if (cull_triangle(pts, width, height, CULL_ALL) == CULL_KEEP) faces.push_back(i);
+    }
+    std::vector<Vec3f> bars(per_face);
+    unsigned seed = 12345;
+    auto rnd = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / float(1 << 24);
+    };
+    for (Vec3f& b : bars) {
+        float u = rnd(), v = rnd();
+        if (u + v > 1) { u = 1 - u; v = 1 - v; }
+        b = Vec3f(1 - u - v, u, v);
+    }
+    size_t nfrag = faces.size() * per_face;
+    std::vector<TGAColor> ref(nfrag), out(nfrag);
+
+    // mode: 0 -  , 1 - prepare() + powf, 2 - prepare() + 
+    auto run = [&](int mode, std::vector<TGAColor>& colors) {
+        double best = 1e30;
+        for (int f = 0; f < frames; f++) {
+            auto t0 = std::chrono::steady_clock::now();
+            size_t k = 0;
+            for (int face : faces) {
+                vcache.restore_face(shader, face);
+                for (int j = 0; j < per_face; j++, k++) {
+                    if (mode == 0) colors[k] = legacy_fragment(shader, bars[j]);
+                    else shader.shade<0>(bars[j], colors[k]);
+                }
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+        return best;
+    };
+    auto compare = [&](int& maxdiff, size_t& ndiff) {
+        maxdiff = 0;
+        ndiff = 0;
+        for (size_t k = 0; k < nfrag; k++) {
+            int d = 0;
+            for (int c = 0; c < 3; c++) d = std::max(d, std::abs((int)out[k].bgra[c] - (int)ref[k].bgra[c]));
+            maxdiff = std::max(maxdiff, d);
+            ndiff += d > 0;
+        }
+    };
+
+    std::cout << nfrag << " fragments, specular exponent " << shader.specular_exponent << std::endl;
+    std::cout << std::left << std::setw(16) << "fragment" << std::right << std::setw(10) << "ms" << std::setw(12) << "ns/frag"
+        << std::setw(10) << "speedup" << std::setw(12) << "max diff" << std::setw(12) << "differ" << std::endl;
+    double base = run(0, ref);
+    auto report = [&](const char* name, double ms, int maxdiff, size_t ndiff) {
+        std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << ms << std::setw(12) << std::setprecision(2) << ms * 1e6 / nfrag
+            << std::setw(9) << base / ms << "x" << std::setw(12) << maxdiff << std::setw(11) << std::setprecision(3)
+            << 100. * ndiff / nfrag << "%" << std::endl;
+    };
+    report("legacy", base, 0, 0);
+
+    const char* names[] = { "prepare+powf", "prepare+table" };
+    for (int mode = 1; mode <= 2; mode++) {
+        shader.specular_mode = mode == 1 ? SPECULAR_POWF : SPECULAR_TABLE;
+        shader.prepare();
+        double ms = run(mode, out);
+        int maxdiff;
+        size_t ndiff;
+        compare(maxdiff, ndiff);
+        report(names[mode - 1], ms, maxdiff, ndiff);
+    }
+    std::cout << "specular table: " << PhongShader::SPECULAR_TABLE_SIZE << " segments, max error "
+        << std::scientific << std::setprecision(2) << shader.specular_table_error() << std::endl;
+    delete model;
+    return 0;
+}
+
+// ======================
+// lights
+// ======================
+static int bench_lights(const char* model_file) {
+    Model* model = new Model(model_file);
+    if (model->nfaces() == 0) {
+        std::cerr << "can't load " << model_file << std::endl;
+        delete model;
+        return 1;
+    }
+    const int width = 800, height = 800, frames = 3;
+    RenderContext context(width, height);
+    DrawCall call(context, *model);
+    PhongShaderT<0> shader;
+    setup_phong(call, shader);
+
+    // G-   ,   
+    GBuffer gbuffer(width, height);
+    VertexCache vcache(*model, shader);
+    ThreadPool pool(1);
+    vcache.transform_all(shader, pool);
+    for (int i = 0; i < model->nfaces(); i++) {
+        Vec4f pts[3];
+        vcache.fetch_face(shader, i, pts);
+        if (cull_triangle(pts, width, height, CULL_ALL) != CULL_KEEP) continue;
+        gbuffer_triangle(pts, shader, gbuffer);
+    }
+
+    //      ,   main()
+    Vec3f lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f);
+    for (int i = 0; i < model->nverts(); i++) {
+        Vec4f clip = shader.uniform_M * embed<4>(model->vert(i), 1.f);
+        Vec3f p = proj<3>(clip / clip[3]);
+        for (int j = 0; j < 3; j++) {
+            lo[j] = std::min(lo[j], p[j]);
+            hi[j] = std::max(hi[j], p[j]);
+        }
+    }
+    float radius = 0.1f * std::max(hi.x - lo.x, hi.y - lo.y);
+
+    TGAImage image[2] = { TGAImage(width, height, TGAImage::RGB), TGAImage(width, height, TGAImage::RGB) };
+    LightGrid grid(width, height);
+    std::cout << std::left << std::setw(8) << "lights" << std::right << std::setw(12) << "all ms" << std::setw(12) << "tiled ms"
+        << std::setw(12) << "grid ms" << std::setw(14) << "per tile" << std::setw(10) << "speedup" << std::setw(12) << "image" << std::endl;
+    for (int n = 1; n <= 1024; n *= 4) {
+        std::vector<Light> lights = make_lights(n, lo, hi, radius);
+        shader.lights = &lights;
+        double ms[3] = { 1e30, 1e30, 1e30 }; //  ,  ( ),  
+        for (int f = 0; f < frames; f++) {
+            shader.light_grid = nullptr;
+            image[0].clear();
+            auto t0 = std::chrono::steady_clock::now();
+            resolve_gbuffer<0>(shader, gbuffer, image[0], pool);
+            auto t1 = std::chrono::steady_clock::now();
+            ms[0] = std::min(ms[0], std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+            shader.light_grid = &grid;
+            image[1].clear();
+            t0 = std::chrono::steady_clock::now();
+            grid.build(lights, context.viewport, pool, &gbuffer);
+            auto t2 = std::chrono::steady_clock::now();
+            resolve_gbuffer<0>(shader, gbuffer, image[1], pool);
+            t1 = std::chrono::steady_clock::now();
+            ms[1] = std::min(ms[1], std::chrono::duration<double, std::milli>(t1 - t0).count());
+            ms[2] = std::min(ms[2], std::chrono::duration<double, std::milli>(t2 - t0).count());
+        }
+        size_t bytes = (size_t)width * height * image[0].get_bytespp();
+        bool same = memcmp(image[0].buffer(), image[1].buffer(), bytes) == 0;
+        std::cout << std::left << std::setw(8) << n << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << ms[0] << std::setw(12) << ms[1] << std::setw(12) << ms[2]
+            << std::setw(14) << std::setprecision(2) << (double)grid.references() / grid.ntiles()
+            << std::setw(9) << ms[0] / ms[1] << "x" << std::setw(12) << (same ? "same" : "DIFFERENT") << std::endl;
+    }
+    delete model;
+    return 0;
+}
+
+// ======================
+// tga
+// ======================
+// RLE-  ,     :   
+//  max_encoded_size() ( encode_tga()   ),   
+//   -      
+static int bench_tga() {
+    const int w = 1000, h = 100;
+    const char* tmp = "bench_tga.tga";
+    const char* patterns[] = { "constant", "noise", "AABBC", "pairs", "runs" };
+    const TGAImage::Format formats[] = { TGAImage::GRAYSCALE, TGAImage::RGB, TGAImage::RGBA };
+    std::cout << std::left << std::setw(10) << "pattern" << std::setw(5) << "bpp" << std::right << std::setw(10) << "ms"
+        << std::setw(10) << "bytes" << std::setw(10) << "bound" << std::setw(12) << "round-trip" << std::endl;
+    int failed = 0;
+    for (int pattern = 0; pattern < 5; pattern++)
+        for (TGAImage::Format format : formats) {
+            TGAImage img(w, h, format);
+            unsigned seed = 12345;
+            auto rnd = [&seed]() {
+                seed = seed * 1664525u + 1013904223u;
+                return (unsigned char)(seed >> 24);
+            };
+            unsigned char* p = img.buffer();
+            size_t npixels = (size_t)w * h;
+            unsigned char value[4] = { 0, 0, 0, 0 };
+            size_t left = 0;
+            for (size_t i = 0; i < npixels; i++) {
+                // left -     value
+                if (left == 0) {
+                    for (int k = 0; k < format; k++) value[k] = rnd();
+                    switch (pattern) {
+                    case 0: left = npixels; break;
+                    case 1: left = 1; break;
+                    case 2: left = (i % 5 == 4) ? 1 : 2; break; // A A B B C
+                    case 3: left = 2; break;
+                    default: left = 1 + rnd() % 5; break;
+                    }
+                }
+                memcpy(p + i * format, value, format);
+                left--;
+            }
+
+            std::vector<unsigned char> encoded;
+            auto t0 = std::chrono::steady_clock::now();
+            size_t size = img.encode_tga(encoded, true);
+            auto t1 = std::chrono::steady_clock::now();
+            size_t bound = img.max_encoded_size(true);
+            TGAImage back;
+            bool same = size <= bound && TGAImage::write_encoded(tmp, encoded) && back.read_tga_file(tmp)
+                && back.get_width() == w && back.get_height() == h && back.get_bytespp() == format
+                && memcmp(back.buffer(), img.buffer(), npixels * format) == 0;
+            if (!same) failed++;
+            std::cout << std::left << std::setw(10) << patterns[pattern] << std::setw(5) << (int)format << std::right << std::fixed
+                << std::setprecision(2) << std::setw(10) << std::chrono::duration<double, std::milli>(t1 - t0).count()
+                << std::setw(10) << size << std::setw(10) << bound << std::setw(12) << (same ? "ok" : "FAILED") << std::endl;
+        }
+    std::remove(tmp);
+    return failed ? 1 : 0;
+}
+
+int run_benchmark(const char* name, const char* model_file) {
+    std::string s(name);
+    if (s == "traversal") return bench_traversal();
+    if (s == "vertex") return bench_vertex();
+    if (s == "shader") return bench_shader(model_file);
+    if (s == "texture") return bench_texture();
+    if (s == "fragment") return bench_fragment(model_file);
+    if (s == "lights") return bench_lights(model_file);
+    if (s == "tga") return bench_tga();
+    std::cerr << "unknown benchmark " << name << ", available: traversal, vertex, shader, texture, fragment, lights, tga" << std::endl;
+    return 1;
+}
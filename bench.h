@@ -0,0 +1,22 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+//  , : KG3 -bench <name>
+//   traversal -   (x , y , get/set  )
+//                  scanline()  800x800, 4K  8K
+//   vertex    -    2.5M :    
+//                scalar/sse2/avx2    ,   
+//   shader    -  fragment()  triangle<Shader>():   
+//                    model_file  PhongShaderT      
+//   texture   -    : TGAImage::get()  Texture
+//               nearest/bilinear/trilinear,        
+//   fragment  - PhongShader      model_file: 
+//               fragment()  prepare()  powf    ,   
+//   lights    -  G-  model_file  1  1024  :
+//                       (LightGrid)
+//   tga       - RLE- TGA 1000x100   , RGB  RGBA   
+//                 :   max_encoded_size()   
+//     main()
+int run_benchmark(const char* name, const char* model_file);
+
+#endif //__BENCH_H__
@@ -0,0 +1,54 @@
+#ifndef __BOUNDED_QUEUE_H__
+#define __BOUNDED_QUEUE_H__
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+//    : push() ,      ,
+// pop() -  -  .  close() pop()   
+//  false   ,       .
+template <class T> class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+    void push(const T& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_space.wait(lock, [&] { return items.size() < capacity; });
+        items.push_back(item);
+        lock.unlock();
+        cv_items.notify_one();
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_items.wait(lock, [&] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = items.front();
+        items.pop_front();
+        lock.unlock();
+        cv_space.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv_items.notify_all();
+    }
+
+private:
+    BoundedQueue(const BoundedQueue&);            //  
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex mtx;
+    std::condition_variable cv_space;
+    std::condition_variable cv_items;
+};
+
+#endif //__BOUNDED_QUEUE_H__
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include "depth_buffer.h"
+
+constexpr float DepthBuffer::CLEAR_VALUE;
+
+DepthBuffer::DepthBuffer(int w, int h) : width(w), height(h), data(w * h, CLEAR_VALUE),
+      hiz_bw((w + HIZ_BLOCK - 1) / HIZ_BLOCK), hiz_bh((h + HIZ_BLOCK - 1) / HIZ_BLOCK),
+      hiz_gw((hiz_bw + HIZ_GROUP - 1) / HIZ_GROUP), hiz_gh((hiz_bh + HIZ_GROUP - 1) / HIZ_GROUP) {
+}
+
+void DepthBuffer::clear(float value) {
+    //     ,   
+    float* p = data.data();
+    size_t n = data.size();
+    for (size_t i = 0; i < n; i++) p[i] = value;
+    std::fill(hiz_blocks.begin(), hiz_blocks.end(), value);
+    std::fill(hiz_groups.begin(), hiz_groups.end(), value);
+}
+
+void DepthBuffer::enable_hiz(bool on) {
+    if (!on) {
+        hiz_blocks.clear();
+        hiz_groups.clear();
+        return;
+    }
+    hiz_blocks.resize((size_t)hiz_bw * hiz_bh);
+    hiz_groups.resize((size_t)hiz_gw * hiz_gh);
+    hiz_build();
+}
+
+void DepthBuffer::hiz_update_block(int bx, int by) {
+    int x0 = bx * HIZ_BLOCK, x1 = std::min(x0 + HIZ_BLOCK, width);
+    int y0 = by * HIZ_BLOCK, y1 = std::min(y0 + HIZ_BLOCK, height);
+    float lo = std::numeric_limits<float>::max();
+    for (int y = y0; y < y1; y++) {
+        const float* p = data.data() + y * width;
+        for (int x = x0; x < x1; x++) lo = std::min(lo, p[x]);
+    }
+    hiz_blocks[bx + by * hiz_bw] = lo;
+}
+
+void DepthBuffer::hiz_build() {
+    if (!hiz_enabled()) return;
+    for (int by = 0; by < hiz_bh; by++)
+        for (int bx = 0; bx < hiz_bw; bx++) hiz_update_block(bx, by);
+    for (int gy = 0; gy < hiz_gh; gy++) {
+        for (int gx = 0; gx < hiz_gw; gx++) {
+            float lo = std::numeric_limits<float>::max();
+            for (int by = gy * HIZ_GROUP; by < std::min((gy + 1) * HIZ_GROUP, hiz_bh); by++)
+                for (int bx = gx * HIZ_GROUP; bx < std::min((gx + 1) * HIZ_GROUP, hiz_bw); bx++)
+                    lo = std::min(lo, hiz_block(bx, by));
+            hiz_groups[gx + gy * hiz_gw] = lo;
+        }
+    }
+}
+
+void DepthBuffer::reset_stats() {
+    stats_.fragments = 0;
+    stats_.hiz_triangles = 0;
+    stats_.hiz_blocks = 0;
+}
+
+float DepthBuffer::get(int x, int y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height) return CLEAR_VALUE;
+    return data[x + y * width];
+}
+
+bool DepthBuffer::set(int x, int y, float depth) {
+    if (x < 0 || y < 0 || x >= width || y >= height) return false;
+    data[x + y * width] = depth;
+    return true;
+}
+
+TGAImage DepthBuffer::to_tga() const {
+    //      0..255,   - 0
+    float lo = std::numeric_limits<float>::max();
+    float hi = -std::numeric_limits<float>::max();
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i] == CLEAR_VALUE) continue;
+        lo = std::min(lo, data[i]);
+        hi = std::max(hi, data[i]);
+    }
+    float scale = hi > lo ? 254.f / (hi - lo) : 0.f;
+
+    TGAImage img(width, height, TGAImage::GRAYSCALE);
+    unsigned char* out = img.buffer();
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i] == CLEAR_VALUE) continue;
+        out[i] = (unsigned char)(1.f + (data[i] - lo) * scale);
+    }
+    return img;
+}
+
+bool DepthBuffer::write_tga_file(const char* filename) const {
+    TGAImage img = to_tga();
+    img.flip_vertically();
+    return img.write_tga_file(filename);
+}
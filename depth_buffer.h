@@ -0,0 +1,76 @@
+#ifndef __DEPTH_BUFFER_H__
+#define __DEPTH_BUFFER_H__
+
+#include <vector>
+#include <limits>
+#include <atomic>
+#include "tgaimage.h"
+
+// Z-  float  8- TGAImage.
+//   -    (    z-).
+//
+//  Z (enable_hiz):    HIZ_BLOCK x HIZ_BLOCK   
+//   HIZ_GROUP x HIZ_GROUP     -   .
+// ,       ,    
+//    ,     (  )   .
+//     :  " - "      .
+class DepthBuffer {
+public:
+    static constexpr float CLEAR_VALUE = -std::numeric_limits<float>::max();
+    static const int HIZ_BLOCK = 8; //    
+    static const int HIZ_GROUP = 8; //  : 64x64 
+
+    DepthBuffer(int w = 0, int h = 0);
+
+    void clear(float value = CLEAR_VALUE);
+
+    //  Z.        ;
+    //      hiz_build(),     
+    // (    ),         
+    void enable_hiz(bool on);
+    bool hiz_enabled() const { return !hiz_blocks.empty(); }
+    float hiz_block(int bx, int by) const { return hiz_blocks[bx + by * hiz_bw]; }
+    float hiz_group(int gx, int gy) const { return hiz_groups[gx + gy * hiz_gw]; }
+    void hiz_update_block(int bx, int by);
+    void hiz_build(); //      ,    
+
+    //    : ,   ,
+    //    Z    8x8
+    struct Stats {
+        std::atomic<long long> fragments;
+        std::atomic<long long> hiz_triangles;
+        std::atomic<long long> hiz_blocks;
+        Stats() : fragments(0), hiz_triangles(0), hiz_blocks(0) {}
+    };
+    Stats& stats() { return stats_; }
+    void reset_stats();
+
+    //     -  
+    float& at(int x, int y) { return data[x + y * width]; }
+    float* row(int y) { return data.data() + y * width; }
+    float* buffer() { return data.data(); }
+
+    //    
+    float get(int x, int y) const;
+    bool set(int x, int y, float depth);
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+
+    //    8- ,    .
+    // write_tga_file()    ,  main()  
+    TGAImage to_tga() const;
+    bool write_tga_file(const char* filename) const;
+
+private:
+    int width;
+    int height;
+    std::vector<float> data;
+
+    int hiz_bw, hiz_bh, hiz_gw, hiz_gh;
+    std::vector<float> hiz_blocks;
+    std::vector<float> hiz_groups;
+    Stats stats_;
+};
+
+#endif //__DEPTH_BUFFER_H__
@@ -0,0 +1,12 @@
+#include "gbuffer.h"
+
+GBuffer::GBuffer(int width, int height)
+    : width(width), height(height), zbuffer(width, height), normal_((size_t)width * height), uv_((size_t)width * height),
+      position_((size_t)width * height), footprint_((size_t)width * height), material_((size_t)width * height, NO_MATERIAL), nfragments(0) {
+}
+
+void GBuffer::clear() {
+    zbuffer.clear();
+    std::fill(material_.begin(), material_.end(), NO_MATERIAL);
+    nfragments = 0;
+}
@@ -0,0 +1,115 @@
+#ifndef __GBUFFER_H__
+#define __GBUFFER_H__
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "depth_buffer.h"
+#include "phong_shader.h"
+#include "rasterizer.h"
+#include "thread_pool.h"
+
+// G-   : , , uv (    uv 
+// mip-),    .
+//   (gbuffer_triangle)      
+//  ,  (resolve_gbuffer)       .
+class GBuffer {
+public:
+    static constexpr unsigned char NO_MATERIAL = 255; //   
+
+    GBuffer(int width, int height);
+    void clear();
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    DepthBuffer& depth() { return zbuffer; }
+
+    //    
+    void set(int x, int y, const PhongSurface& s, unsigned char material) {
+        size_t i = (size_t)y * width + x;
+        normal_[i] = s.n;
+        uv_[i] = s.uv;
+        position_[i] = s.p;
+        footprint_[i] = s.footprint;
+        material_[i] = material;
+    }
+    PhongSurface surface(int x, int y) const {
+        size_t i = (size_t)y * width + x;
+        PhongSurface s;
+        s.n = normal_[i];
+        s.uv = uv_[i];
+        s.p = position_[i];
+        s.footprint = footprint_[i];
+        return s;
+    }
+    unsigned char material(int x, int y) const { return material_[(size_t)y * width + x]; }
+
+    //       (    )
+    long long fragments() const { return nfragments; }
+    void add_fragments(long long n) { nfragments += n; }
+
+private:
+    int width, height;
+    DepthBuffer zbuffer;
+    std::vector<Vec3f> normal_;
+    std::vector<Vec2f> uv_;
+    std::vector<Vec3f> position_;
+    std::vector<float> footprint_;
+    std::vector<unsigned char> material_;
+    std::atomic<long long> nfragments;
+};
+
+// Output  draw_triangle():   -  
+template <class Shader> struct GBufferOutput {
+    const Shader& shader;
+    GBuffer& gbuffer;
+    unsigned char material;
+    long long count;
+
+    GBufferOutput(const Shader& shader, GBuffer& gbuffer, unsigned char material)
+        : shader(shader), gbuffer(gbuffer), material(material), count(0) {}
+    bool operator()(int x, int y, Vec3f bar) {
+        gbuffer.set(x, y, shader.surface(bar), material);
+        count++;
+        return false;
+    }
+};
+
+//     ; varying-   ,   triangle()
+template <class Shader> void gbuffer_triangle(Vec4f* pts, const Shader& shader, GBuffer& gbuffer,
+                                              Vec2i clipmin, Vec2i clipmax, unsigned char material = 0) {
+    GBufferOutput<Shader> out(shader, gbuffer, material);
+    draw_triangle(pts, gbuffer.depth(), clipmin, clipmax, out);
+    gbuffer.add_fragments(out.count);
+}
+
+template <class Shader> void gbuffer_triangle(Vec4f* pts, const Shader& shader, GBuffer& gbuffer) {
+    gbuffer_triangle(pts, shader, gbuffer, Vec2i(0, 0), Vec2i(gbuffer.get_width() - 1, gbuffer.get_height() - 1));
+}
+
+//  : shader.light<Features>()    ,
+//     pool.    
+template <unsigned Features> long long resolve_gbuffer(const PhongShader& shader, const GBuffer& gbuffer, TGAImage& image, ThreadPool& pool) {
+    const int ROWS = 16; //   
+    int width = gbuffer.get_width(), height = gbuffer.get_height();
+    int bytespp = image.get_bytespp();
+    std::vector<long long> shaded(pool.size(), 0);
+    pool.parallel_for((height + ROWS - 1) / ROWS, [&](int worker, int band) {
+        for (int y = band * ROWS; y < std::min(height, band * ROWS + ROWS); y++) {
+            unsigned char* row = image.scanline(y);
+            for (int x = 0; x < width; x++) {
+                if (gbuffer.material(x, y) == GBuffer::NO_MATERIAL) continue;
+                TGAColor color = shader.light<Features>(gbuffer.surface(x, y));
+                memcpy(row + x * bytespp, color.bgra, bytespp);
+                shaded[worker]++;
+            }
+        }
+    });
+    long long total = 0;
+    for (size_t i = 0; i < shaded.size(); i++) total += shaded[i];
+    return total;
+}
+
+#endif //__GBUFFER_H__
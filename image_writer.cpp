@@ -0,0 +1,75 @@
+#include <chrono>
+#include "image_writer.h"
+
+ImageWriter::ImageWriter(int max_pending) : max_pending(max_pending > 0 ? max_pending : 1), active(false), stop(false),
+    nwritten(0), nfailed(0), busy(0) {
+    worker = std::thread(&ImageWriter::worker_loop, this);
+}
+
+ImageWriter::~ImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv_job.notify_one();
+    worker.join();
+}
+
+void ImageWriter::write(TGAImage&& image, const std::string& filename, bool rle, bool flip) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_done.wait(lock, [&] { return (int)queue.size() < max_pending; });
+    queue.push_back(Job{ std::move(image), filename, rle, flip });
+    lock.unlock();
+    cv_job.notify_one();
+}
+
+void ImageWriter::wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_done.wait(lock, [&] { return queue.empty() && !active; });
+}
+
+int ImageWriter::written() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nwritten;
+}
+
+int ImageWriter::failed() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nfailed;
+}
+
+double ImageWriter::busy_ms() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return busy;
+}
+
+void ImageWriter::worker_loop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_job.wait(lock, [&] { return stop || !queue.empty(); });
+            if (queue.empty()) return; // stop   
+            job = std::move(queue.front());
+            queue.pop_front();
+            active = true;
+        }
+        cv_done.notify_all(); //    
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (job.flip) job.image.flip_vertically();
+        job.image.encode_tga(encoded, job.rle);
+        bool ok = TGAImage::write_encoded(job.filename.c_str(), encoded);
+        job.image = TGAImage(); //      
+        auto t1 = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            active = false;
+            if (ok) nwritten++;
+            else nfailed++;
+            busy += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        }
+        cv_done.notify_all();
+    }
+}
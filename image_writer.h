@@ -0,0 +1,56 @@
+#ifndef __IMAGE_WRITER_H__
+#define __IMAGE_WRITER_H__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "tgaimage.h"
+
+//     : write()     ,
+// , RLE-        
+//  .   max_pending  -    ,
+// write() ,      .
+class ImageWriter {
+public:
+    explicit ImageWriter(int max_pending = 2);
+    ~ImageWriter(); //  ,    
+
+    // flip -      ( main()  )
+    void write(TGAImage&& image, const std::string& filename, bool rle = true, bool flip = false);
+    void wait(); // ,        
+
+    int written() const;
+    int failed() const;
+    double busy_ms() const; //        
+
+private:
+    struct Job {
+        TGAImage image;
+        std::string filename;
+        bool rle;
+        bool flip;
+    };
+
+    ImageWriter(const ImageWriter&);            //  
+    ImageWriter& operator=(const ImageWriter&);
+
+    void worker_loop();
+
+    std::deque<Job> queue;
+    int max_pending;
+    bool active; //   ,    
+    bool stop;
+    int nwritten;
+    int nfailed;
+    double busy;
+    std::vector<unsigned char> encoded; //  ,   
+    mutable std::mutex mtx;
+    std::condition_variable cv_job;
+    std::condition_variable cv_done;
+    std::thread worker;
+};
+
+#endif //__IMAGE_WRITER_H__
@@ -0,0 +1,125 @@
+#include <limits>
+#include "light_grid.h"
+#include "gbuffer.h"
+
+LightGrid::LightGrid(int width, int height)
+    : width(width), height(height), tiles_x((width + TILE - 1) / TILE), tiles_y((height + TILE - 1) / TILE),
+      sx(1), ox(0), sy(1), oy(0), offsets(tiles_x * tiles_y + 1, 0) {
+}
+
+//      ;   (lo > hi)   
+static float box_distance2(const Vec3f& c, const Vec3f& lo, const Vec3f& hi) {
+    float d2 = 0;
+    for (int i = 0; i < 3; i++) {
+        float d = 0;
+        if (c[i] < lo[i]) d = lo[i] - c[i];
+        else if (c[i] > hi[i]) d = c[i] - hi[i];
+        d2 += d * d;
+    }
+    return d2;
+}
+
+void LightGrid::build(const std::vector<Light>& lights, const Matrix& viewport, ThreadPool& pool, const GBuffer* gbuffer) {
+    sx = viewport[0][0];
+    ox = viewport[0][3];
+    sy = viewport[1][1];
+    oy = viewport[1][3];
+    const float inf = std::numeric_limits<float>::infinity();
+    int n = ntiles();
+
+    //     
+    std::vector<Vec3f> lo(n, Vec3f(inf, inf, inf)), hi(n, Vec3f(-inf, -inf, -inf));
+    if (!gbuffer) {
+        //         tile_of(),  z  
+        for (int t = 0; t < n; t++) {
+            float x0 = ((t % tiles_x) * TILE - 1 - ox) / sx, x1 = ((t % tiles_x + 1) * TILE + 1 - ox) / sx;
+            float y0 = ((t / tiles_x) * TILE - 1 - oy) / sy, y1 = ((t / tiles_x + 1) * TILE + 1 - oy) / sy;
+            lo[t] = Vec3f(std::min(x0, x1), std::min(y0, y1), -inf);
+            hi[t] = Vec3f(std::max(x0, x1), std::max(y0, y1), inf);
+        }
+    }
+    else {
+        //        p,   lights_at(),      :
+        //       ,     
+        std::vector<std::vector<Vec3f> > local_lo(pool.size(), lo), local_hi(pool.size(), hi);
+        pool.parallel_for(tiles_y, [&](int worker, int band) {
+            std::vector<Vec3f>& l = local_lo[worker];
+            std::vector<Vec3f>& h = local_hi[worker];
+            for (int y = band * TILE; y < std::min(height, band * TILE + TILE); y++) {
+                for (int x = 0; x < width; x++) {
+                    if (gbuffer->material(x, y) == GBuffer::NO_MATERIAL) continue;
+                    Vec3f p = gbuffer->surface(x, y).p;
+                    int t = tile_of(p);
+                    for (int i = 0; i < 3; i++) {
+                        l[t][i] = std::min(l[t][i], p[i]);
+                        h[t][i] = std::max(h[t][i], p[i]);
+                    }
+                }
+            }
+        });
+        for (size_t w = 0; w < local_lo.size(); w++) {
+            for (int t = 0; t < n; t++) {
+                for (int i = 0; i < 3; i++) {
+                    lo[t][i] = std::min(lo[t][i], local_lo[w][t][i]);
+                    hi[t][i] = std::max(hi[t][i], local_hi[w][t][i]);
+                }
+            }
+        }
+    }
+
+    //       -    
+    struct TileRange { int x0, y0, x1, y1; };
+    std::vector<TileRange> range(lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        const Light& l = lights[i];
+        float x0 = sx * (l.position.x - l.radius) + ox, x1 = sx * (l.position.x + l.radius) + ox;
+        float y0 = sy * (l.position.y - l.radius) + oy, y1 = sy * (l.position.y + l.radius) + oy;
+        range[i].x0 = (int)std::floor(std::min(x0, x1) / TILE) - 1;
+        range[i].y0 = (int)std::floor(std::min(y0, y1) / TILE) - 1;
+        range[i].x1 = (int)std::floor(std::max(x0, x1) / TILE) + 1;
+        range[i].y1 = (int)std::floor(std::max(y0, y1) / TILE) + 1;
+    }
+
+    std::vector<std::vector<int> > lists(n);
+    pool.parallel_for(tiles_y, [&](int, int ty) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int t = tx + ty * tiles_x;
+            std::vector<int>& list = lists[t];
+            list.clear();
+            for (size_t i = 0; i < lights.size(); i++) {
+                const TileRange& r = range[i];
+                if (tx < r.x0 || ty < r.y0 || tx > r.x1 || ty > r.y1) continue;
+                const Light& l = lights[i];
+                if (box_distance2(l.position, lo[t], hi[t]) < l.radius * l.radius) list.push_back((int)i);
+            }
+        }
+    });
+
+    indices.clear();
+    for (int t = 0; t < n; t++) {
+        offsets[t] = (int)indices.size();
+        indices.insert(indices.end(), lists[t].begin(), lists[t].end());
+    }
+    offsets[n] = (int)indices.size();
+}
+
+std::vector<Light> make_lights(int n, Vec3f lo, Vec3f hi, float radius, unsigned seed) {
+    auto rnd = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / float(1 << 24);
+    };
+    std::vector<Light> lights(n);
+    for (int i = 0; i < n; i++) {
+        Light& l = lights[i];
+        l.type = i % 2 ? LIGHT_SPOT : LIGHT_POINT;
+        for (int k = 0; k < 3; k++) l.position[k] = lo[k] + (hi[k] - lo[k]) * rnd();
+        //   
+        for (int k = 0; k < 3; k++) l.color[k] = 0.2f + 0.6f * rnd();
+        l.radius = radius;
+        //  z -   ,      z
+        l.direction = Vec3f(rnd() - 0.5f, rnd() - 0.5f, -1.f).normalize();
+        l.cos_inner = 0.9f;
+        l.cos_outer = 0.7f;
+    }
+    return lights;
+}
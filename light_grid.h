@@ -0,0 +1,78 @@
+#ifndef __LIGHT_GRID_H__
+#define __LIGHT_GRID_H__
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "geometry.h"
+#include "model.h"
+#include "thread_pool.h"
+
+class GBuffer;
+
+enum LightType {
+    LIGHT_POINT,
+    LIGHT_SPOT
+};
+
+//    .  -    , 
+// PhongSurface::p (     w: x  y   [-1, 1]).
+//       radius,     -
+//       .
+struct Light {
+    LightType type;
+    Vec3f position;
+    Vec3f color;
+    float radius;
+    //   :   ()  
+    //  ( )   ()  
+    Vec3f direction;
+    float cos_inner;
+    float cos_outer;
+};
+
+//   :     TILE x TILE,  
+//    ,     .
+//      ,      
+//    ,      .
+class LightGrid {
+public:
+    static const int TILE = 16;
+
+    LightGrid(int width, int height);
+
+    // viewport -  Viewport:    p   .
+    //  G-  -     .  G-  
+    //      x, y  z,      
+    void build(const std::vector<Light>& lights, const Matrix& viewport, ThreadPool& pool, const GBuffer* gbuffer = nullptr);
+
+    //  ,     p (  ,   build())
+    ConstSpan<int> lights_at(const Vec3f& p) const {
+        int t = tile_of(p);
+        return ConstSpan<int>(indices.data() + offsets[t], offsets[t + 1] - offsets[t]);
+    }
+
+    int ntiles() const { return tiles_x * tiles_y; }
+    long long references() const { return (long long)indices.size(); } //   
+
+private:
+    int tile_of(const Vec3f& p) const {
+        int tx = (int)std::floor((sx * p.x + ox) / TILE);
+        int ty = (int)std::floor((sy * p.y + oy) / TILE);
+        tx = std::max(0, std::min(tiles_x - 1, tx));
+        ty = std::max(0, std::min(tiles_y - 1, ty));
+        return tx + ty * tiles_x;
+    }
+
+    int width, height;
+    int tiles_x, tiles_y;
+    float sx, ox, sy, oy; // x  y   : Viewport  z
+    std::vector<int> offsets; //     indices: [offsets[t], offsets[t + 1])
+    std::vector<int> indices;
+};
+
+// n     [lo, hi]  ,  - ,
+//     .     -lights  main()
+std::vector<Light> make_lights(int n, Vec3f lo, Vec3f hi, float radius, unsigned seed = 12345);
+
+#endif //__LIGHT_GRID_H__
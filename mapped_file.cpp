@@ -0,0 +1,99 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : ptr(nullptr), length(0), opened(false), writable(false), file(INVALID_HANDLE_VALUE), mapping(nullptr) {
+}
+
+bool MappedFile::open(const char* filename, bool copy_on_write) {
+    close();
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        close();
+        return false;
+    }
+    length = (size_t)size.QuadPart;
+    opened = true;
+    if (length == 0) return true; //    ,    
+    mapping = CreateFileMappingA(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        return false;
+    }
+    ptr = (const char*)MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (!ptr) {
+        close();
+        return false;
+    }
+    writable = copy_on_write;
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    ptr = nullptr;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+    length = 0;
+    opened = false;
+    writable = false;
+}
+
+#else
+
+MappedFile::MappedFile() : ptr(nullptr), length(0), opened(false), writable(false), fd(-1) {
+}
+
+bool MappedFile::open(const char* filename, bool copy_on_write) {
+    close();
+    fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+    length = (size_t)st.st_size;
+    opened = true;
+    if (length == 0) return true; //    ,    
+    // MAP_PRIVATE:       
+    void* p = mmap(nullptr, length, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    ptr = (const char*)p;
+    writable = copy_on_write;
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) munmap((void*)ptr, length);
+    if (fd >= 0) ::close(fd);
+    ptr = nullptr;
+    fd = -1;
+    length = 0;
+    opened = false;
+    writable = false;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
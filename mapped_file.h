@@ -0,0 +1,38 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+
+// ,       (mmap / CreateFileMapping).
+//  copy_on_write   :   
+//   ,     
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char* filename, bool copy_on_write = false);
+    void close();
+
+    bool is_open() const { return opened; }
+    const char* data() const { return ptr; }
+    char* writable_data() { return writable ? (char*)ptr : nullptr; } //   copy_on_write
+    size_t size() const { return length; }
+
+private:
+    MappedFile(const MappedFile&);            //  
+    MappedFile& operator=(const MappedFile&);
+
+    const char* ptr;
+    size_t length;
+    bool opened;
+    bool writable;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int fd;
+#endif
+};
+
+#endif //__MAPPED_FILE_H__
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstdint>
+#include "mesh_clusters.h"
+#include "our_gl.h"
+
+namespace {
+
+// 10   ,   x, y, z
+uint32_t expand_bits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint32_t morton3(Vec3f p) {
+    uint32_t c[3];
+    for (int j = 0; j < 3; j++) c[j] = (uint32_t)std::min(1023.f, std::max(0.f, p[j] * 1024.f));
+    return (expand_bits(c[0]) << 2) | (expand_bits(c[1]) << 1) | expand_bits(c[2]);
+}
+
+void grow(Vec3f& lo, Vec3f& hi, const Vec3f& p) {
+    for (int j = 0; j < 3; j++) {
+        lo[j] = std::min(lo[j], p[j]);
+        hi[j] = std::max(hi[j], p[j]);
+    }
+}
+
+} // namespace
+
+MeshClusters::MeshClusters(const Model& model, int cluster_size) {
+    int nfaces = model.nfaces();
+    if (nfaces == 0) return;
+    if (cluster_size <= 0) cluster_size = CLUSTER_SIZE;
+
+    Vec3f lo = model.vert(0), hi = model.vert(0);
+    for (int i = 1; i < model.nverts(); i++) grow(lo, hi, model.vert(i));
+    Vec3f extent = hi - lo;
+    for (int j = 0; j < 3; j++) if (!(extent[j] > 0)) extent[j] = 1;
+
+    //          ;
+    //    32  ,    
+    std::vector<uint64_t> keys(nfaces);
+    for (int i = 0; i < nfaces; i++) {
+        Vec3f c = (model.vert(i, 0) + model.vert(i, 1) + model.vert(i, 2)) * (1.f / 3.f) - lo;
+        keys[i] = ((uint64_t)morton3(Vec3f(c.x / extent.x, c.y / extent.y, c.z / extent.z)) << 32) | (uint32_t)i;
+    }
+    //    10    : ,    
+    //    
+    std::vector<uint64_t> tmp(nfaces);
+    for (int shift = 32; shift < 62; shift += 10) {
+        int count[1025] = { 0 };
+        for (int i = 0; i < nfaces; i++) count[((keys[i] >> shift) & 1023) + 1]++;
+        for (int d = 0; d < 1024; d++) count[d + 1] += count[d];
+        for (int i = 0; i < nfaces; i++) tmp[count[(keys[i] >> shift) & 1023]++] = keys[i];
+        keys.swap(tmp);
+    }
+    faces.resize(nfaces);
+    for (int i = 0; i < nfaces; i++) faces[i] = (int)(uint32_t)keys[i];
+
+    for (int first = 0; first < nfaces; first += cluster_size) {
+        Cluster c;
+        c.first = first;
+        c.count = std::min(cluster_size, nfaces - first);
+        c.lo = c.hi = model.vert(faces[first], 0);
+        for (int k = first; k < first + c.count; k++)
+            for (int j = 0; j < 3; j++) grow(c.lo, c.hi, model.vert(faces[k], j));
+        clusters.push_back(c);
+    }
+    nodes.reserve(2 * clusters.size());
+    build_node(0, (int)clusters.size());
+}
+
+int MeshClusters::build_node(int first, int count) {
+    int index = (int)nodes.size();
+    nodes.push_back(Node());
+    Node n;
+    n.first = first;
+    n.count = count;
+    n.left = n.right = -1;
+    if (count == 1) {
+        n.lo = clusters[first].lo;
+        n.hi = clusters[first].hi;
+    }
+    else {
+        int half = count / 2;
+        n.left = build_node(first, half);
+        n.right = build_node(first + half, count - half);
+        n.lo = nodes[n.left].lo;
+        n.hi = nodes[n.left].hi;
+        grow(n.lo, n.hi, nodes[n.right].lo);
+        grow(n.lo, n.hi, nodes[n.right].hi);
+    }
+    nodes[index] = n;
+    return index;
+}
+
+MeshClusters::CullStats MeshClusters::cull(const Matrix& transform, int width, int height, std::vector<unsigned char>& visible) const {
+    CullStats stats = { 0, 0, 0, 0 };
+    visible.assign(faces.size(), 0);
+    if (!nodes.empty()) cull_node(0, transform, width, height, visible, stats);
+    return stats;
+}
+
+void MeshClusters::cull_node(int node, const Matrix& transform, int width, int height,
+    std::vector<unsigned char>& visible, CullStats& stats) const {
+    const Node& n = nodes[node];
+    Vec4f corners[8];
+    for (int c = 0; c < 8; c++) {
+        Vec3f p(c & 1 ? n.hi.x : n.lo.x, c & 2 ? n.hi.y : n.lo.y, c & 4 ? n.hi.z : n.lo.z);
+        corners[c] = transform * embed<4>(p, 1.f);
+    }
+    stats.tested++;
+    FrustumResult r = classify_frustum(corners, 8, width, height);
+    if (r == FRUSTUM_OUTSIDE) {
+        stats.culled += n.count;
+        return;
+    }
+    //   -      
+    if (r == FRUSTUM_INSIDE || n.left < 0) {
+        mark(n.first, n.count, visible, stats);
+        return;
+    }
+    cull_node(n.left, transform, width, height, visible, stats);
+    cull_node(n.right, transform, width, height, visible, stats);
+}
+
+void MeshClusters::mark(int first_cluster, int count, std::vector<unsigned char>& visible, CullStats& stats) const {
+    for (int k = first_cluster; k < first_cluster + count; k++) {
+        const Cluster& c = clusters[k];
+        for (int i = c.first; i < c.first + c.count; i++) visible[faces[i]] = 1;
+        stats.faces += c.count;
+    }
+    stats.visible += count;
+}
@@ -0,0 +1,60 @@
+#ifndef __MESH_CLUSTERS_H__
+#define __MESH_CLUSTERS_H__
+
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+
+//          .
+//            CLUSTER_SIZE
+// ,      (AABB).    BVH:
+//     ,    
+//    . cull()      
+// ,     ;    ,  
+//   .   ,  cull_triangle()  
+//    CULLED_OUTSIDE,    .
+class MeshClusters {
+public:
+    static const int CLUSTER_SIZE = 128;
+
+    struct CullStats {
+        int tested;      //   ( BVH)
+        int culled;      //  
+        int visible;     //  
+        int faces;       //    
+    };
+
+    explicit MeshClusters(const Model& model, int cluster_size = CLUSTER_SIZE);
+
+    // transform - Viewport * MVP,     . visible[i] = 1  
+    //  , 0  ;  - model.nfaces()
+    CullStats cull(const Matrix& transform, int width, int height, std::vector<unsigned char>& visible) const;
+
+    int nclusters() const { return (int)clusters.size(); }
+    int nnodes() const { return (int)nodes.size(); }
+    //    ( BVH)
+    Vec3f bounds_min() const { return nodes.empty() ? Vec3f() : nodes[0].lo; }
+    Vec3f bounds_max() const { return nodes.empty() ? Vec3f() : nodes[0].hi; }
+
+private:
+    struct Cluster {
+        Vec3f lo, hi;
+        int first, count; //  faces
+    };
+    struct Node {
+        Vec3f lo, hi;
+        int first, count;  //  clusters
+        int left, right;   // , -1  
+    };
+
+    int build_node(int first, int count);
+    void cull_node(int node, const Matrix& transform, int width, int height,
+        std::vector<unsigned char>& visible, CullStats& stats) const;
+    void mark(int first_cluster, int count, std::vector<unsigned char>& visible, CullStats& stats) const;
+
+    std::vector<int> faces; //    
+    std::vector<Cluster> clusters;
+    std::vector<Node> nodes;
+};
+
+#endif //__MESH_CLUSTERS_H__
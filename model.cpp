@@ -1,110 +1,247 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include "model.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
 
-Model::Model(const char* filename) : verts_(), faces_(), norms_(), uv_(), diffusemap_(), normalmap_(), specularmap_() {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vec3f v;
-            for (int i = 0; i < 3; i++) iss >> v[i];
-            verts_.push_back(v);
-        }
-        else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            Vec3f n;
-            for (int i = 0; i < 3; i++) iss >> n[i];
-            norms_.push_back(n);
-        }
-        else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            Vec2f uv;
-            for (int i = 0; i < 2; i++) iss >> uv[i];
-            uv_.push_back(uv);
+// Binary mesh cache. It is written next to the .obj on the first load and
+// memory-mapped on later runs; the Model then reads the arrays in place.
+// All arrays follow the header back to back: positions (Vec3f), uvs (Vec2f),
+// normals (Vec3f), all nverts long, then 3 * nfaces vertex indices (int).
+static const char MESH_CACHE_MAGIC[4] = { 'K', 'G', '3', 'M' };
+static const uint32_t MESH_CACHE_VERSION = 4;
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;  // size and mtime of the .obj: the cache is rebuilt when they change
+    int64_t source_mtime;
+    uint32_t nverts, nfaces;
+};
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(float) && sizeof(Vec2f) == 2 * sizeof(float), "vectors must be tightly packed");
+static_assert(sizeof(MeshCacheHeader) % sizeof(float) == 0, "arrays after the header must stay aligned");
+
+static std::string mesh_cache_filename(const char* filename) {
+    std::string cachefile(filename);
+    size_t dot = cachefile.find_last_of(".");
+    if (dot != std::string::npos) cachefile = cachefile.substr(0, dot);
+    return cachefile + ".kg3mesh";
+}
+
+Model::Model(const char* filename) : positions_(), uvs_(), normals_(), indices_(), cache_(), diffusemap_(), normalmap_(), specularmap_() {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        std::promise<void> none;
+        none.set_value();
+        textures_ = none.get_future().share();
+        return;
+    }
+
+    // Maps are decoded on a small pool of their own, overlapping the geometry below
+    std::string name(filename);
+    textures_ = std::async(std::launch::async, [this, name]() {
+        struct Map { const char* suffix; Texture* tex; };
+        const Map maps[] = { { "_diffuse.tga", &diffusemap_ }, { "_nm.tga", &normalmap_ }, { "_spec.tga", &specularmap_ } };
+        const int nmaps = sizeof(maps) / sizeof(maps[0]);
+        ThreadPool pool(std::min(nmaps, ThreadPool::hardware_threads()));
+        pool.parallel_for(nmaps, [&](int, int i) { load_texture(name, maps[i].suffix, *maps[i].tex); });
+    }).share();
+
+    std::string cachefile = mesh_cache_filename(filename);
+    if (load_cache(cachefile, (uint64_t)st.st_size, (int64_t)st.st_mtime)) {
+        std::cerr << "mesh cache " << cachefile << " mapped" << std::endl;
+    } else {
+        if (!load_obj(filename)) return;
+        use_vectors();
+        if (!save_cache(cachefile, (uint64_t)st.st_size, (int64_t)st.st_mtime))
+            std::cerr << "can't write mesh cache " << cachefile << std::endl;
+    }
+    std::cerr << "# v# " << nverts() << " f# " << nfaces() << std::endl;
+}
+
+bool Model::load_obj(const char* filename) {
+    ObjData obj;
+    if (!parse_obj(filename, obj)) return false;
+    if (obj.polygons) std::cerr << obj.polygons << " polygons split into triangles" << std::endl;
+    if (obj.bad_faces) std::cerr << "warning: " << obj.bad_faces << " malformed faces skipped" << std::endl;
+
+    // Merge corners with the same v/vt/vn into one vertex. Vertices sharing
+    // a position are chained through next[], so the lookup needs no hashing.
+    std::vector<int> head(obj.verts.size(), -1), next;
+    std::vector<Vec3i> keys; // v/vt/vn of every merged vertex
+    indices_.resize(obj.corners.size());
+    for (size_t i = 0; i < obj.corners.size(); i++) {
+        Vec3i c = obj.corners[i];
+        if (c[2] < 0) c[2] = -1 - (int)(i / 3); // no vn: the vertex gets the face normal and is not shared
+        int u = head[c[0]];
+        while (u >= 0 && !(keys[u][1] == c[1] && keys[u][2] == c[2])) u = next[u];
+        if (u < 0) {
+            u = (int)keys.size();
+            keys.push_back(c);
+            next.push_back(head[c[0]]);
+            head[c[0]] = u;
         }
-        else if (!line.compare(0, 2, "f ")) {
-            std::vector<Vec3i> f;
-            Vec3i tmp;
-            iss >> trash;
-            while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
-                for (int i = 0; i < 3; i++) tmp[i]--; // in wavefront obj all indices start at 1, not zero
-                f.push_back(tmp);
-            }
-            faces_.push_back(f);
+        indices_[i] = u;
+    }
+
+    positions_.resize(keys.size());
+    uvs_.resize(keys.size());
+    normals_.resize(keys.size());
+    for (size_t u = 0; u < keys.size(); u++) {
+        const Vec3i& k = keys[u];
+        positions_[u] = obj.verts[k[0]];
+        uvs_[u] = k[1] < 0 ? Vec2f(0, 0) : obj.uvs[k[1]];
+        if (k[2] >= 0) {
+            normals_[u] = obj.norms[k[2]];
+        } else {
+            const Vec3i* f = &obj.corners[3 * (size_t)(-1 - k[2])];
+            Vec3f v0 = obj.verts[f[0][0]];
+            normals_[u] = cross(obj.verts[f[1][0]] - v0, obj.verts[f[2][0]] - v0);
         }
+        // a zero-area face (or a zero vn) has no direction, normalizing it would give NaN
+        float len = normals_[u].norm();
+        normals_[u] = len > 0 && std::isfinite(len) ? normals_[u] * (1.f / len) : Vec3f(0, 0, 1);
     }
-    std::cerr << "# v# " << verts_.size() << " f# " << faces_.size() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
-    load_texture(filename, "_diffuse.tga", diffusemap_);
-    load_texture(filename, "_nm.tga", normalmap_);
-    load_texture(filename, "_spec.tga", specularmap_);
+    return true;
+}
+
+void Model::use_vectors() {
+    position_span_ = ConstSpan<Vec3f>(positions_.data(), positions_.size());
+    uv_span_ = ConstSpan<Vec2f>(uvs_.data(), uvs_.size());
+    normal_span_ = ConstSpan<Vec3f>(normals_.data(), normals_.size());
+    index_span_ = ConstSpan<int>(indices_.data(), indices_.size());
 }
 
-Model::~Model() {}
+bool Model::load_cache(const std::string& cachefile, uint64_t source_size, int64_t source_mtime) {
+    if (!cache_.open(cachefile.c_str())) return false;
+    MeshCacheHeader h;
+    bool ok = cache_.size() >= sizeof(h);
+    if (ok) {
+        memcpy(&h, cache_.data(), sizeof(h));
+        ok = memcmp(h.magic, MESH_CACHE_MAGIC, 4) == 0 && h.version == MESH_CACHE_VERSION
+            && h.source_size == source_size && h.source_mtime == source_mtime; // otherwise stale
+    }
+    if (ok) {
+        uint64_t expected = sizeof(h) + (uint64_t)h.nverts * (2 * sizeof(Vec3f) + sizeof(Vec2f)) + (uint64_t)h.nfaces * 3 * sizeof(int);
+        ok = cache_.size() == expected; // truncated or foreign file
+    }
+    if (!ok) {
+        cache_.close();
+        return false;
+    }
+
+    const char* p = cache_.data() + sizeof(h);
+    position_span_ = ConstSpan<Vec3f>((const Vec3f*)p, h.nverts);
+    p += h.nverts * sizeof(Vec3f);
+    uv_span_ = ConstSpan<Vec2f>((const Vec2f*)p, h.nverts);
+    p += h.nverts * sizeof(Vec2f);
+    normal_span_ = ConstSpan<Vec3f>((const Vec3f*)p, h.nverts);
+    p += h.nverts * sizeof(Vec3f);
+    index_span_ = ConstSpan<int>((const int*)p, h.nfaces * 3);
 
-int Model::nverts() {
-    return (int)verts_.size();
+    // indices come from disk, check them once here instead of on every access
+    for (size_t i = 0; ok && i < index_span_.size(); i++) ok = index_span_[i] >= 0 && index_span_[i] < (int)h.nverts;
+    if (!ok) {
+        cache_.close();
+        use_vectors();
+    }
+    return ok;
 }
 
-int Model::nfaces() {
-    return (int)faces_.size();
+// The temporary file is named after the process, so concurrent runs never write into the same one
+static std::string cache_temp_filename(const std::string& cachefile) {
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    long pid = (long)getpid();
+#endif
+    return cachefile + "." + std::to_string(pid) + ".tmp";
 }
 
-std::vector<int> Model::face(int idx) {
-    std::vector<int> face;
-    for (int i = 0; i < (int)faces_[idx].size(); i++) face.push_back(faces_[idx][i][0]);
-    return face;
+// Replaces an existing target in one step: readers find either the old file or the new one
+static bool replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
 }
 
-Vec3f Model::vert(int i) {
-    return verts_[i];
+bool Model::save_cache(const std::string& cachefile, uint64_t source_size, int64_t source_mtime) {
+    MeshCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_CACHE_MAGIC, 4);
+    h.version = MESH_CACHE_VERSION;
+    h.source_size = source_size;
+    h.source_mtime = source_mtime;
+    h.nverts = (uint32_t)nverts();
+    h.nfaces = (uint32_t)nfaces();
+
+    // write to a temporary file first so that a concurrent run never maps a half-written cache
+    std::string tmpfile = cache_temp_filename(cachefile);
+    std::ofstream out(tmpfile.c_str(), std::ios::binary);
+    if (!out) return false;
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)positions_.data(), positions_.size() * sizeof(Vec3f));
+    out.write((const char*)uvs_.data(), uvs_.size() * sizeof(Vec2f));
+    out.write((const char*)normals_.data(), normals_.size() * sizeof(Vec3f));
+    out.write((const char*)indices_.data(), indices_.size() * sizeof(int));
+    out.close();
+    if (!out) {
+        std::remove(tmpfile.c_str());
+        return false;
+    }
+    if (!replace_file(tmpfile, cachefile)) {
+        std::remove(tmpfile.c_str());
+        return false;
+    }
+    return true;
 }
 
-Vec3f Model::vert(int iface, int nthvert) {
-    return verts_[faces_[iface][nthvert][0]];
+Model::~Model() {
+    // the loader writes into this object
+    if (textures_.valid()) textures_.wait();
 }
 
-void Model::load_texture(std::string filename, const char* suffix, TGAImage& img) {
+void Model::load_texture(std::string filename, const char* suffix, Texture& tex) {
     std::string texfile(filename);
     size_t dot = texfile.find_last_of(".");
     if (dot != std::string::npos) {
         texfile = texfile.substr(0, dot) + std::string(suffix);
-        std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
-        img.flip_vertically();
+        TGAImage img;
+        // rows bottom-up, as uv index them; uncompressed files are used straight from the mapping
+        bool ok = img.map_tga_file(texfile.c_str(), true) || img.read_tga_file(texfile.c_str(), true);
+        std::cerr << "texture file " + texfile + " loading " + (ok ? "ok" : "failed") + "\n"; // one write, loaders run in parallel
+        tex.build(img);
     }
 }
 
-TGAColor Model::diffuse(Vec2f uvf) {
-    Vec2i uv(uvf[0] * diffusemap_.get_width(), uvf[1] * diffusemap_.get_height());
-    return diffusemap_.get(uv[0], uv[1]);
-}
-
-Vec3f Model::normal(Vec2f uvf) {
-    Vec2i uv(uvf[0] * normalmap_.get_width(), uvf[1] * normalmap_.get_height());
-    TGAColor c = normalmap_.get(uv[0], uv[1]);
-    Vec3f res;
-    for (int i = 0; i < 3; i++)
-        res[2 - i] = (float)c[i] / 255.f * 2.f - 1.f;
-    return res;
-}
-
-Vec2f Model::uv(int iface, int nthvert) {
-    return uv_[faces_[iface][nthvert][1]];
+TGAColor Model::diffuse(Vec2f uv) const {
+    textures_.wait();
+    Vec3f c = diffusemap_.sample(uv, 0, FILTER_NEAREST) * 255.f;
+    return TGAColor((unsigned char)(c.x + .5f), (unsigned char)(c.y + .5f), (unsigned char)(c.z + .5f));
 }
 
-float Model::specular(Vec2f uvf) {
-    Vec2i uv(uvf[0] * specularmap_.get_width(), uvf[1] * specularmap_.get_height());
-    return specularmap_.get(uv[0], uv[1])[0] / 1.f;
+Vec3f Model::normal(Vec2f uv) const {
+    textures_.wait();
+    return normalmap_.sample(uv, 0, FILTER_NEAREST) * 2.f - Vec3f(1, 1, 1);
 }
 
-Vec3f Model::normal(int iface, int nthvert) {
-    int idx = faces_[iface][nthvert][2];
-    return norms_[idx].normalize();
+float Model::specular(Vec2f uv) const {
+    textures_.wait();
+    return specularmap_.sample(uv, 0, FILTER_NEAREST).z * 255.f;
 }
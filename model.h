@@ -2,34 +2,80 @@
 #define __MODEL_H__
 #include <vector>
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <future>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
+#include "mapped_file.h"
 
+// Read-only view of a contiguous array (std::span is C++20)
+template <typename T> class ConstSpan {
+public:
+    ConstSpan() : ptr_(nullptr), size_(0) {}
+    ConstSpan(const T* ptr, size_t size) : ptr_(ptr), size_(size) {}
+    const T* data() const { return ptr_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* begin() const { return ptr_; }
+    const T* end() const { return ptr_ + size_; }
+    const T& operator[](size_t i) const { return ptr_[i]; }
+private:
+    const T* ptr_;
+    size_t size_;
+};
+
+// Indexed triangle mesh. Every distinct v/vt/vn combination of the OBJ file is one
+// vertex with a position, a uv and a unit normal stored in parallel flat arrays;
+// face i is vertices indices()[3 * i], [3 * i + 1], [3 * i + 2].
+// The arrays either live in the vectors below or point straight into the mapped mesh cache.
 class Model {
 private:
-    std::vector<Vec3f> verts_;
-    std::vector<std::vector<Vec3i> > faces_; // attention, this Vec3i means vertex/uv/normal
-    std::vector<Vec3f> norms_;
-    std::vector<Vec2f> uv_;
+    std::vector<Vec3f> positions_;
+    std::vector<Vec2f> uvs_;
+    std::vector<Vec3f> normals_;
+    std::vector<int> indices_;
+    MappedFile cache_;
+
+    ConstSpan<Vec3f> position_span_;
+    ConstSpan<Vec2f> uv_span_;
+    ConstSpan<Vec3f> normal_span_;
+    ConstSpan<int> index_span_;
 
-    void load_texture(std::string filename, const char* suffix, TGAImage& img);
+    bool load_obj(const char* filename);
+    bool load_cache(const std::string& cachefile, uint64_t source_size, int64_t source_mtime);
+    bool save_cache(const std::string& cachefile, uint64_t source_size, int64_t source_mtime);
+    void use_vectors();
+    static void load_texture(std::string filename, const char* suffix, Texture& tex);
+    std::shared_future<void> textures_;
 public:
     Model(const char* filename);
     ~Model();
-    TGAImage diffusemap_;
-    TGAImage normalmap_;
-    TGAImage specularmap_;
-    int nverts();
-    int nfaces();
-    Vec3f normal(int iface, int nthvert);
-    Vec3f normal(Vec2f uv);
-    Vec3f vert(int i);
-    Vec3f vert(int iface, int nthvert);
-    Vec2f uv(int iface, int nthvert);
-    TGAColor diffuse(Vec2f uv);
-    float specular(Vec2f uv);
-    std::vector<int> face(int idx);
+    // Mip-mapped maps for PhongShader (see texture.h). They are decoded in the
+    // background while the geometry loads: wait on textures() before sampling them
+    Texture diffusemap_;
+    Texture normalmap_;
+    Texture specularmap_;
+
+    ConstSpan<Vec3f> positions() const { return position_span_; }
+    ConstSpan<Vec2f> uvs() const { return uv_span_; }
+    ConstSpan<Vec3f> normals() const { return normal_span_; }
+    ConstSpan<int> indices() const { return index_span_; }
+    ConstSpan<int> face(int iface) const { return ConstSpan<int>(index_span_.data() + 3 * iface, 3); }
 
+    int nverts() const { return (int)position_span_.size(); }
+    int nfaces() const { return (int)(index_span_.size() / 3); }
+    Vec3f vert(int i) const { return position_span_[i]; }
+    Vec3f vert(int iface, int nthvert) const { return position_span_[index_span_[3 * iface + nthvert]]; }
+    Vec2f uv(int iface, int nthvert) const { return uv_span_[index_span_[3 * iface + nthvert]]; }
+    Vec3f normal(int iface, int nthvert) const { return normal_span_[index_span_[3 * iface + nthvert]]; }
+    // Ready when all maps are loaded (or failed to load)
+    std::shared_future<void> textures() const { return textures_; }
 
+    // Nearest texel of the top mip level, waits for the maps
+    Vec3f normal(Vec2f uv) const;
+    TGAColor diffuse(Vec2f uv) const;
+    float specular(Vec2f uv) const;
 };
 #endif //__MODEL_H__
@@ -0,0 +1,241 @@
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+namespace {
+
+const size_t MIN_CHUNK = 256 * 1024; //    
+const int MISSING = -0x7fffffff;     //   ;    -1
+
+//     .   
+//     ,     
+//       
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uvs;
+    std::vector<Vec3f> norms;
+    std::vector<Vec3i> corners;
+    std::vector<size_t> relative; //  (corner * 3 + k) ,    
+    int polygons;
+    int bad_faces;
+};
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+//      kw,    
+inline bool keyword(const char* p, const char* end, const char* kw) {
+    size_t n = strlen(kw);
+    return (size_t)(end - p) > n && !memcmp(p, kw, n) && is_space(p[n]);
+}
+
+// from_chars    '+',  OBJ-   
+inline bool parse_float(const char*& p, const char* end, float& v) {
+    p = skip_spaces(p, end);
+    if (p < end && *p == '+') p++;
+    std::from_chars_result r = std::from_chars(p, end, v);
+    if (r.ec != std::errc()) return false;
+    p = r.ptr;
+    return true;
+}
+
+inline bool parse_int(const char*& p, const char* end, int& v) {
+    if (p < end && *p == '+') p++;
+    std::from_chars_result r = std::from_chars(p, end, v);
+    if (r.ec != std::errc() || v == 0) return false; //  OBJ   1
+    p = r.ptr;
+    return true;
+}
+
+//  : v, v/vt, v//vn  v/vt/vn
+bool parse_corner(const char*& p, const char* end, const int count[3], Vec3i& c, bool rel[3]) {
+    int idx[3] = { 0, 0, 0 };
+    if (!parse_int(p, end, idx[0])) return false;
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            if (!parse_int(p, end, idx[1])) return false;
+        }
+        if (p < end && *p == '/') {
+            p++;
+            if (!parse_int(p, end, idx[2])) return false;
+        }
+    }
+    if (p < end && !is_space(*p)) return false;
+    for (int k = 0; k < 3; k++) {
+        rel[k] = idx[k] < 0;
+        if (idx[k] > 0) c[k] = idx[k] - 1;         // ,  
+        else if (idx[k] < 0) c[k] = count[k] + idx[k]; //   ,    
+        else c[k] = MISSING;
+    }
+    return true;
+}
+
+void parse_face(const char* p, const char* end, ObjChunk& chunk, std::vector<Vec3i>& poly, std::vector<unsigned char>& polyrel) {
+    int count[3] = { (int)chunk.verts.size(), (int)chunk.uvs.size(), (int)chunk.norms.size() };
+    poly.clear();
+    polyrel.clear();
+    for (p = skip_spaces(p, end); p < end; p = skip_spaces(p, end)) {
+        Vec3i c;
+        bool rel[3];
+        if (!parse_corner(p, end, count, c, rel)) {
+            chunk.bad_faces++;
+            return;
+        }
+        poly.push_back(c);
+        polyrel.push_back((unsigned char)(rel[0] | rel[1] << 1 | rel[2] << 2));
+    }
+    if (poly.size() < 3) {
+        chunk.bad_faces++;
+        return;
+    }
+    if (poly.size() > 3) chunk.polygons++;
+    //    
+    for (size_t i = 1; i + 1 < poly.size(); i++) {
+        size_t tri[3] = { 0, i, i + 1 };
+        for (int j = 0; j < 3; j++) {
+            for (int k = 0; k < 3; k++)
+                if (polyrel[tri[j]] >> k & 1) chunk.relative.push_back(chunk.corners.size() * 3 + k);
+            chunk.corners.push_back(poly[tri[j]]);
+        }
+    }
+}
+
+void parse_chunk(ObjChunk& chunk) {
+    std::vector<Vec3i> poly;
+    std::vector<unsigned char> polyrel;
+    const char* line = chunk.begin;
+    while (line < chunk.end) {
+        const char* eol = (const char*)memchr(line, '\n', chunk.end - line);
+        if (!eol) eol = chunk.end;
+        //    : "f 1 2 3 # ..." -   
+        const char* stop = (const char*)memchr(line, '#', eol - line);
+        if (!stop) stop = eol;
+        const char* p = skip_spaces(line, stop);
+        if (keyword(p, stop, "v")) {
+            p += 2;
+            Vec3f v;
+            if (parse_float(p, stop, v.x) && parse_float(p, stop, v.y) && parse_float(p, stop, v.z)) chunk.verts.push_back(v);
+        }
+        else if (keyword(p, stop, "vt")) {
+            p += 3;
+            Vec2f uv;
+            if (parse_float(p, stop, uv.x) && parse_float(p, stop, uv.y)) chunk.uvs.push_back(uv);
+        }
+        else if (keyword(p, stop, "vn")) {
+            p += 3;
+            Vec3f n;
+            if (parse_float(p, stop, n.x) && parse_float(p, stop, n.y) && parse_float(p, stop, n.z)) chunk.norms.push_back(n);
+        }
+        else if (keyword(p, stop, "f")) {
+            parse_face(p + 2, stop, chunk, poly, polyrel);
+        }
+        line = eol < chunk.end ? eol + 1 : chunk.end;
+    }
+}
+
+template <class T>
+void append(std::vector<T>& dst, size_t offset, const std::vector<T>& src) {
+    if (!src.empty()) memcpy(&dst[offset], src.data(), src.size() * sizeof(T));
+}
+
+} // namespace
+
+bool parse_obj(const char* filename, ObjData& out, int nthreads) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* data = file.data();
+    size_t size = file.size();
+
+    ThreadPool pool(nthreads);
+    size_t nchunks = std::max<size_t>(1, std::min<size_t>(pool.size() * 4, size / MIN_CHUNK));
+
+    //       
+    std::vector<ObjChunk> chunks(nchunks);
+    const char* prev = data;
+    for (size_t i = 0; i < nchunks; i++) {
+        const char* end = data + size;
+        if (i + 1 < nchunks) {
+            end = std::max(prev, data + size * (i + 1) / nchunks);
+            const char* eol = (const char*)memchr(end, '\n', data + size - end);
+            end = eol ? eol + 1 : data + size;
+        }
+        chunks[i].begin = prev;
+        chunks[i].end = end;
+        chunks[i].polygons = 0;
+        chunks[i].bad_faces = 0;
+        prev = end;
+    }
+
+    pool.parallel_for((int)nchunks, [&](int, int i) { parse_chunk(chunks[i]); });
+
+    // :     
+    std::vector<size_t> base_v(nchunks + 1, 0), base_vt(nchunks + 1, 0), base_vn(nchunks + 1, 0), base_c(nchunks + 1, 0);
+    out.polygons = 0;
+    out.bad_faces = 0;
+    for (size_t i = 0; i < nchunks; i++) {
+        base_v[i + 1] = base_v[i] + chunks[i].verts.size();
+        base_vt[i + 1] = base_vt[i] + chunks[i].uvs.size();
+        base_vn[i + 1] = base_vn[i] + chunks[i].norms.size();
+        base_c[i + 1] = base_c[i] + chunks[i].corners.size();
+        out.polygons += chunks[i].polygons;
+        out.bad_faces += chunks[i].bad_faces;
+    }
+    out.verts.resize(base_v[nchunks]);
+    out.uvs.resize(base_vt[nchunks]);
+    out.norms.resize(base_vn[nchunks]);
+    out.corners.resize(base_c[nchunks]);
+    int count[3] = { (int)out.verts.size(), (int)out.uvs.size(), (int)out.norms.size() };
+
+    std::vector<int> bad_tris(nchunks, 0);
+    pool.parallel_for((int)nchunks, [&](int, int i) {
+        ObjChunk& chunk = chunks[i];
+        append(out.verts, base_v[i], chunk.verts);
+        append(out.uvs, base_vt[i], chunk.uvs);
+        append(out.norms, base_vn[i], chunk.norms);
+        int base[3] = { (int)base_v[i], (int)base_vt[i], (int)base_vn[i] };
+        for (size_t j = 0; j < chunk.relative.size(); j++) {
+            size_t r = chunk.relative[j];
+            chunk.corners[r / 3][(int)(r % 3)] += base[r % 3];
+        }
+        //          
+        for (size_t t = 0; t < chunk.corners.size(); t += 3) {
+            bool ok = true;
+            for (int j = 0; j < 3; j++)
+                for (int k = 0; k < 3; k++) {
+                    int& idx = chunk.corners[t + j][k];
+                    if (idx == MISSING && k > 0) idx = -1;
+                    else ok = ok && idx >= 0 && idx < count[k];
+                }
+            if (!ok) {
+                chunk.corners[t].x = -1;
+                bad_tris[i]++;
+            }
+        }
+        append(out.corners, base_c[i], chunk.corners);
+    });
+
+    int nbad = 0;
+    for (size_t i = 0; i < nchunks; i++) nbad += bad_tris[i];
+    if (nbad) {
+        size_t n = 0;
+        for (size_t t = 0; t < out.corners.size(); t += 3) {
+            if (out.corners[t].x < 0) continue;
+            for (int j = 0; j < 3; j++) out.corners[n++] = out.corners[t + j];
+        }
+        out.corners.resize(n);
+        out.bad_faces += nbad;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef __OBJ_PARSER_H__
+#define __OBJ_PARSER_H__
+
+#include <vector>
+#include "geometry.h"
+
+//   Wavefront OBJ.     ,
+//    , -1 -    (  v  v//vn)
+struct ObjData {
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uvs;
+    std::vector<Vec3f> norms;
+    std::vector<Vec3i> corners; // v/vt/vn,    
+    int polygons;               //      
+    int bad_faces;              //           
+};
+
+//           ;
+//        .
+// nthreads = 0 -   
+bool parse_obj(const char* filename, ObjData& out, int nthreads = 0);
+
+#endif //__OBJ_PARSER_H__
@@ -1,35 +1,46 @@
 #include <cmath>
 #include <limits>
 #include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <algorithm>
 #include "our_gl.h"
-
-Matrix ModelView;
-Matrix Viewport;
-Matrix Projection;
+#include "rasterizer.h"
 
 IShader::~IShader() {}
 
-void viewport(int x, int y, int w, int h) {
-    Viewport = Matrix::identity();
+RenderContext::RenderContext(int width, int height, TGAImage* image, DepthBuffer* zbuffer) :
+    width(width), height(height), image(image), zbuffer(zbuffer), viewport(::viewport(0, 0, width, height)) {
+}
+
+DrawCall::DrawCall(const RenderContext& context, const Model& model) :
+    context(&context), model(&model), model_view(Matrix::identity()), projection(Matrix::identity()) {
+}
+
+Matrix viewport(int x, int y, int w, int h) {
+    Matrix Viewport = Matrix::identity();
     Viewport[0][3] = x + w / 2.f;
     Viewport[1][3] = y + h / 2.f;
     Viewport[2][3] = 255.f / 2.f;
     Viewport[0][0] = w / 2.f;
     Viewport[1][1] = h / 2.f;
     Viewport[2][2] = 255.f / 2.f;
+    return Viewport;
 }
 
-void projection(float coeff) {
-    Projection = Matrix::identity();
+Matrix projection(float coeff) {
+    Matrix Projection = Matrix::identity();
     Projection[3][2] = coeff;
+    return Projection;
 }
 
-void lookat(Vec3f eye, Vec3f center, Vec3f up) {
+Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
     Vec3f z = (eye - center).normalize();
     Vec3f x = cross(up, z).normalize();
     Vec3f y = cross(z, x).normalize();
 
-    ModelView = Matrix::identity();
+    Matrix ModelView = Matrix::identity();
     for (int i = 0; i < 3; i++) {
         ModelView[0][i] = x[i];
         ModelView[1][i] = y[i];
@@ -43,67 +54,158 @@ void lookat(Vec3f eye, Vec3f center, Vec3f up) {
     translation[1][3] = -eye.y;
     translation[2][3] = -eye.z;
 
-    ModelView = ModelView * translation;
+    return ModelView * translation;
+}
+
+// ======================
+//  ( - )
+// ======================
+static const float CLIP_NEAR_W = 1e-3f; //  : w >= CLIP_NEAR_W
+
+//  n * p + d >= 0
+struct ClipPlane {
+    Vec4f n;
+    float d;
+    float dist(const Vec4f& p) const { return n * p + d; }
+};
+
+static ClipPlane make_plane(float nx, float ny, float nw, float d) {
+    ClipPlane pl;
+    pl.n[0] = nx;
+    pl.n[1] = ny;
+    pl.n[3] = nw;
+    pl.d = d;
+    return pl;
 }
 
-Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P) {
-    Vec3f s[2];
-    for (int i = 2; i--; ) {
-        s[i][0] = C[i] - A[i];
-        s[i][1] = B[i] - A[i];
-        s[i][2] = A[i] - P[i];
+//     ; guard -      
+static int frustum_planes(int width, int height, float guard, ClipPlane* planes) {
+    planes[0] = make_plane(0, 0, 1, -CLIP_NEAR_W);                 // w >= eps
+    planes[1] = make_plane(1, 0, guard, 0);                         // x >= -guard
+    planes[2] = make_plane(-1, 0, width - 1 + guard, 0);            // x <= width - 1 + guard
+    planes[3] = make_plane(0, 1, guard, 0);                         // y >= -guard
+    planes[4] = make_plane(0, -1, height - 1 + guard, 0);           // y <= height - 1 + guard
+    return 5;
+}
+
+static int clip_polygon(const ClipPlane& plane, int n, const Vec4f* pts, const Vec3f* bar, Vec4f* out_pts, Vec3f* out_bar) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        float di = plane.dist(pts[i]);
+        float dj = plane.dist(pts[j]);
+        if (di >= 0) {
+            out_pts[m] = pts[i];
+            out_bar[m] = bar[i];
+            m++;
+        }
+        if ((di >= 0) != (dj >= 0)) {
+            float t = di / (di - dj);
+            out_pts[m] = pts[i] + (pts[j] - pts[i]) * t;
+            out_bar[m] = bar[i] + (bar[j] - bar[i]) * t;
+            m++;
+        }
     }
-    Vec3f u = cross(s[0], s[1]);
-    if (std::abs(u[2]) > 1e-2)
-        return Vec3f(1.f - (u.x + u.y) / u.z, u.y / u.z, u.x / u.z);
-    return Vec3f(-1, 1, 1);
+    return m;
 }
 
-void triangle(Vec4f* pts, IShader& shader, TGAImage& image, TGAImage& zbuffer) {
-    Vec2f bboxmin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-    Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+//       
+static bool outside_screen(Vec4f* pts, int width, int height) {
+    ClipPlane planes[5];
+    int nplanes = frustum_planes(width, height, 0.f, planes);
+    for (int k = 0; k < nplanes; k++) {
+        if (planes[k].dist(pts[0]) < 0 && planes[k].dist(pts[1]) < 0 && planes[k].dist(pts[2]) < 0)
+            return true;
+    }
+    return false;
+}
+
+ClipResult clip_triangle(Vec4f* pts, int width, int height, ClippedPolygon& poly) {
+    poly.n = 3;
     for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 2; j++) {
-            bboxmin[j] = std::min(bboxmin[j], pts[i][j] / pts[i][3]);
-            bboxmax[j] = std::max(bboxmax[j], pts[i][j] / pts[i][3]);
-        }
+        poly.pts[i] = pts[i];
+        poly.bar[i] = Vec3f(i == 0, i == 1, i == 2);
     }
+    if (outside_screen(pts, width, height)) return CLIP_REJECTED;
+
+    //          :
+    // ,       ,   
+    ClipPlane planes[5];
+    float guard = (float)std::max(width, height);
+    int nplanes = frustum_planes(width, height, guard, planes);
+    bool inside = true;
+    for (int k = 0; k < nplanes && inside; k++)
+        for (int i = 0; i < 3 && inside; i++)
+            inside = planes[k].dist(pts[i]) >= 0;
+    if (inside) return CLIP_INSIDE;
 
-    //  bounding box  
-    bboxmin.x = std::max(0.f, std::min((float)image.get_width() - 1, bboxmin.x));
-    bboxmin.y = std::max(0.f, std::min((float)image.get_height() - 1, bboxmin.y));
-    bboxmax.x = std::max(0.f, std::min((float)image.get_width() - 1, bboxmax.x));
-    bboxmax.y = std::max(0.f, std::min((float)image.get_height() - 1, bboxmax.y));
-
-    Vec2i P;
-    TGAColor color;
-    for (P.x = (int)bboxmin.x; P.x <= (int)bboxmax.x; P.x++) {
-        for (P.y = (int)bboxmin.y; P.y <= (int)bboxmax.y; P.y++) {
-            //      
-            Vec3f c = barycentric(proj<2>(pts[0] / pts[0][3]),
-                proj<2>(pts[1] / pts[1][3]),
-                proj<2>(pts[2] / pts[2][3]),
-                proj<2>(P));
-            //  / 
-    
-            if (c.x < 0 || c.y < 0 || c.z < 0) continue;
-
-            float z = pts[0][2] * c.x +
-                pts[1][2] * c.y +
-                pts[2][2] * c.z;
-            float w = pts[0][3] * c.x + pts[1][3] * c.y + pts[2][3] * c.z;
-
-            float depth = z / w;
-            int frag_depth = std::max(0, std::min(255, int((depth + 1.0f) * 255.0f / 2.0f)));
-
-            //  
-            if (zbuffer.get(P.x, P.y)[0] <= frag_depth) {
-                bool discard = shader.fragment(c, color);
-                if (!discard) {
-                    zbuffer.set(P.x, P.y, TGAColor(frag_depth));
-                    image.set(P.x, P.y, color);
-                }
-            }
+    Vec4f tmp_pts[MAX_CLIP_VERTS];
+    Vec3f tmp_bar[MAX_CLIP_VERTS];
+    for (int k = 0; k < nplanes && poly.n >= 3; k++) {
+        int n = clip_polygon(planes[k], poly.n, poly.pts, poly.bar, tmp_pts, tmp_bar);
+        for (int i = 0; i < n; i++) {
+            poly.pts[i] = tmp_pts[i];
+            poly.bar[i] = tmp_bar[i];
         }
+        poly.n = n;
     }
-}
\ No newline at end of file
+    return poly.n >= 3 ? CLIP_CLIPPED : CLIP_REJECTED;
+}
+
+// ======================
+// 
+// ======================
+CullResult cull_triangle(Vec4f* pts, int width, int height, int mode) {
+    if (outside_screen(pts, width, height)) return CULLED_OUTSIDE;
+
+    //    ,      ,
+    //     clip_triangle()
+    for (int i = 0; i < 3; i++)
+        if (!(pts[i][3] >= CLIP_NEAR_W)) return CULL_KEEP;
+
+    Vec2f v[3];
+    for (int i = 0; i < 3; i++) v[i] = Vec2f(pts[i][0] / pts[i][3], pts[i][1] / pts[i][3]);
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+
+    //   ,    TriangleSetup::init()
+    if ((mode & CULL_ZERO_AREA) && !(std::abs(area) > 1e-2)) return CULLED_ZERO_AREA;
+    if ((mode & CULL_BACK) && area < 0) return CULLED_BACKFACE;
+
+    if (mode & CULL_NO_SAMPLES) {
+        //     : bounding box      
+        float xmin = std::min(v[0].x, std::min(v[1].x, v[2].x));
+        float xmax = std::max(v[0].x, std::max(v[1].x, v[2].x));
+        float ymin = std::min(v[0].y, std::min(v[1].y, v[2].y));
+        float ymax = std::max(v[0].y, std::max(v[1].y, v[2].y));
+        if (std::ceil(xmin) > std::floor(xmax) || std::ceil(ymin) > std::floor(ymax)) return CULLED_NO_SAMPLES;
+    }
+    return CULL_KEEP;
+}
+
+FrustumResult classify_frustum(const Vec4f* pts, int n, int width, int height) {
+    //    (   ):      
+    // ,  ,       
+    ClipPlane planes[5];
+    int nplanes = frustum_planes(width, height, 1.f, planes);
+    planes[0].d = -0.5f * CLIP_NEAR_W;
+    bool inside = true;
+    for (int k = 0; k < nplanes; k++) {
+        int nout = 0;
+        for (int i = 0; i < n; i++) nout += planes[k].dist(pts[i]) < 0;
+        if (nout == n) return FRUSTUM_OUTSIDE;
+        if (nout) inside = false;
+    }
+    return inside ? FRUSTUM_INSIDE : FRUSTUM_INTERSECTS;
+}
+
+void triangle(Vec4f* pts, IShader& shader, TGAImage& image, DepthBuffer& zbuffer) {
+    triangle<IShader>(pts, shader, image, zbuffer);
+}
+
+void triangle(Vec4f* pts, IShader& shader, TGAImage& image, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax) {
+    triangle<IShader>(pts, shader, image, zbuffer, clipmin, clipmax);
+}
+
+void triangle(Vec4f* pts, IShader& shader, const RenderContext& context) {
+    triangle<IShader>(pts, shader, context);
+}
@@ -3,22 +3,101 @@
 
 #include "tgaimage.h"
 #include "geometry.h"
+#include "depth_buffer.h"
 
-extern Matrix ModelView;
-extern Matrix Viewport;
-extern Matrix Projection;
+class Model;
 
+//     ,   RenderContext  DrawCall
+Matrix viewport(int x, int y, int w, int h);
+Matrix projection(float coeff = 0.f); // coeff = -1/c
+Matrix lookat(Vec3f eye, Vec3f center, Vec3f up);
 
-void viewport(int x, int y, int w, int h);
-void projection(float coeff = 0.f); // coeff = -1/c
-void lookat(Vec3f eye, Vec3f center, Vec3f up);
+//  : , z-   NDC ->  (viewport   ).
+// image  zbuffer    ,    (G-,  )
+struct RenderContext {
+    int width;
+    int height;
+    TGAImage* image;
+    DepthBuffer* zbuffer;
+    Matrix viewport;
+
+    RenderContext(int width, int height, TGAImage* image = nullptr, DepthBuffer* zbuffer = nullptr);
+};
+
+//   : ,    ,    .
+//   DrawCall  bind()       viewport, 
+//     DrawCall  RenderContext     
+struct DrawCall {
+    const RenderContext* context;
+    const Model* model;
+    Matrix model_view;
+    Matrix projection;
+
+    DrawCall(const RenderContext& context, const Model& model);
+    Matrix mvp() const { return projection * model_view; }
+    const Matrix& viewport() const { return context->viewport; }
+};
 
 struct IShader {
+    const DrawCall* draw = nullptr; //  bind(),   clone()    DrawCall
+
     virtual ~IShader();
+    void bind(const DrawCall& call) { draw = &call; }
     virtual Vec4f vertex(int iface, int nthvert) = 0;
     virtual bool fragment(Vec3f bar, TGAColor& color) = 0;
+    virtual IShader* clone() const = 0; //    
+    //   : ,     uniform-,    ,
+    //     fragment().    uniform-,  vertex()  clone()
+    virtual void prepare() {}
+
+    //   (. vertex_cache.h):     
+    //   , varying-      varying_size() float-
+    //      . 0 -    .
+    virtual int varying_size() const { return 0; }
+    virtual Vec4f vertex_indexed(int ivert, float* varyings) { return Vec4f(); }
+    virtual void set_varyings(int nthvert, const float* varyings) {}
+    //  [begin, end) : pts[i - begin]  varyings + (i - begin) * varying_size().
+    //          
+    virtual void vertex_batch(int begin, int end, Vec4f* pts, float* varyings) {
+        for (int i = begin; i < end; i++) pts[i - begin] = vertex_indexed(i, varyings + (size_t)(i - begin) * varying_size());
+    }
+};
+
+//     : pts -  vertex(),
+// .. Viewport * clip    w. Viewport   w  ,
+//         .
+const int MAX_CLIP_VERTS = 9;
+struct ClippedPolygon {
+    int n;
+    Vec4f pts[MAX_CLIP_VERTS];
+    Vec3f bar[MAX_CLIP_VERTS]; //      
 };
+enum ClipResult { CLIP_REJECTED, CLIP_INSIDE, CLIP_CLIPPED };
+// width/height -  ; CLIP_INSIDE -   , poly   
+ClipResult clip_triangle(Vec4f* pts, int width, int height, ClippedPolygon& poly);
+
+//     (  )
+enum CullMode {
+    CULL_NONE = 0,
+    CULL_BACK = 1,        //  :     
+    CULL_ZERO_AREA = 2,   //  
+    CULL_NO_SAMPLES = 4,  // bounding box      
+    CULL_ALL = CULL_BACK | CULL_ZERO_AREA | CULL_NO_SAMPLES
+};
+enum CullResult { CULL_KEEP, CULLED_OUTSIDE, CULLED_BACKFACE, CULLED_ZERO_AREA, CULLED_NO_SAMPLES, CULL_RESULT_COUNT };
+// pts -  vertex();      
+CullResult cull_triangle(Vec4f* pts, int width, int height, int mode);
+
+//     n  (   Viewport * clip)   
+// ,   . FRUSTUM_OUTSIDE -     , 
+//     cull_triangle()    CULLED_OUTSIDE.
+// FRUSTUM_INSIDE -     ,     
+enum FrustumResult { FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTS, FRUSTUM_INSIDE };
+FrustumResult classify_frustum(const Vec4f* pts, int n, int width, int height);
 
-void triangle(Vec4f* pts, IShader& shader, TGAImage& image, TGAImage& zbuffer);
+void triangle(Vec4f* pts, IShader& shader, TGAImage& image, DepthBuffer& zbuffer);
+void triangle(Vec4f* pts, IShader& shader, const RenderContext& context);
+// clipmin/clipmax -    (),   
+void triangle(Vec4f* pts, IShader& shader, TGAImage& image, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax);
 
 #endif //__OUR_GL_H__
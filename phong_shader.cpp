@@ -1,112 +1,118 @@
 #include "phong_shader.h"
+#include "vertex_kernel.h"
 #include <cmath>
+#include <algorithm>
+#include <cstring>
 
-//   
-extern Model* model;
+//   viewport -  DrawCall,   bind()
 
 Vec4f PhongShader::vertex(int iface, int nthvert) {
-    Vec2f uv = model->uv(iface, nthvert);
-    varying_uv[nthvert] = uv;
+    float varyings[VARYING_SIZE];
+    Vec4f gl_Vertex = vertex_indexed(draw->model->face(iface)[nthvert], varyings);
+    set_varyings(nthvert, varyings);
+    return gl_Vertex;
+}
+
+Vec4f PhongShader::vertex_indexed(int ivert, float* varyings) {
+    const Model* model = draw->model;
+    Vec2f uv = model->uvs()[ivert];
+    varyings[0] = uv.x;
+    varyings[1] = uv.y;
 
-    Vec3f n = model->normal(iface, nthvert);
-    varying_nrm[nthvert] = proj<3>(uniform_MIT * embed<4>(n, 0.f));
+    Vec3f n = proj<3>(uniform_MIT * embed<4>(model->normals()[ivert], 0.f));
+    for (int i = 0; i < 3; i++) varyings[2 + i] = n[i];
 
-    Vec3f v = model->vert(iface, nthvert);
-    Vec4f gl_Vertex = embed<4>(v, 1.f);
+    Vec4f gl_Vertex = embed<4>(model->positions()[ivert], 1.f);
 
-    Vec4f clip = Projection * ModelView * gl_Vertex;
+    Vec4f clip = uniform_M * gl_Vertex; // uniform_M = DrawCall::mvp()
     Vec3f ndc = proj<3>(clip / clip[3]);
-    varying_tri[nthvert] = ndc;
+    for (int i = 0; i < 3; i++) varyings[5 + i] = ndc[i];
 
-    return Viewport * clip;
+    return draw->viewport() * clip;
 }
 
-bool PhongShader::fragment(Vec3f bar, TGAColor& color) {
-    //  UV 
-    Vec2f uv_interpolated(0, 0);
-    for (int i = 0; i < 3; i++) {
-        uv_interpolated.x += varying_uv[i][0] * bar[i];
-        uv_interpolated.y += varying_uv[i][1] * bar[i];
-    }
-
-    //  
-    Vec3f n_interpolated(0, 0, 0);
-    for (int i = 0; i < 3; i++) {
-        n_interpolated.x += varying_nrm[i][0] * bar[i];
-        n_interpolated.y += varying_nrm[i][1] * bar[i];
-        n_interpolated.z += varying_nrm[i][2] * bar[i];
+void PhongShader::vertex_batch(int begin, int end, Vec4f* pts, float* varyings) {
+    const int BATCH = 256;
+    Vec3f ndc[BATCH], nrm[BATCH];
+    const Model* model = draw->model;
+    VertexTransform xf = { uniform_M, draw->viewport(), uniform_MIT };
+    ConstSpan<Vec2f> uvs = model->uvs();
+    for (int b = begin; b < end; b += BATCH) {
+        int n = std::min(BATCH, end - b);
+        transform_vertices(xf, &model->positions()[b], &model->normals()[b], n, pts + (b - begin), ndc, nrm);
+        for (int k = 0; k < n; k++) {
+            float* v = varyings + (size_t)(b - begin + k) * VARYING_SIZE;
+            v[0] = uvs[b + k].x;
+            v[1] = uvs[b + k].y;
+            for (int i = 0; i < 3; i++) {
+                v[2 + i] = nrm[k][i];
+                v[5 + i] = ndc[k][i];
+            }
+        }
     }
-    n_interpolated = n_interpolated.normalize();
+}
 
-    // ====================
-    //   
-    // ====================
-    Vec3f n = n_interpolated; //   ,    
+void PhongShader::set_varyings(int nthvert, const float* varyings) {
+    memcpy(varying[nthvert], varyings, sizeof(varying[nthvert]));
+    if (nthvert == 2) update_footprint(); //     
+}
 
-    //   
-    Vec3f p(0, 0, 0);
+void PhongShader::update_footprint() {
+    //    ( Viewport    )   uv
+    Vec2f s[3], uv[3];
     for (int i = 0; i < 3; i++) {
-        p.x += varying_tri[i][0] * bar[i];
-        p.y += varying_tri[i][1] * bar[i];
-        p.z += varying_tri[i][2] * bar[i];
+        s[i] = Vec2f(varying[i][5] * screen_scale.x, varying[i][6] * screen_scale.y);
+        uv[i] = Vec2f(varying[i][0], varying[i][1]);
     }
-
-    //  
-    Vec3f light_dir_normalized = light_dir.normalize();
-    Vec3f view_dir_normalized = view_dir.normalize();
-    Vec3f to_camera = (camera_pos - p).normalize();
-
-    //  
-    float NdotL = std::max(0.0f, n * light_dir_normalized);
-    float diff = NdotL;
-
-    //  
-    float spec = 0.0f;
-    if (diff > 0) {
-        Vec3f half_vector = (light_dir_normalized + to_camera).normalize();
-        float NdotH = std::max(0.0f, n * half_vector);
-        spec = powf(NdotH, specular_exponent);
+    Vec2f e1 = s[1] - s[0], e2 = s[2] - s[0];
+    Vec2f t1 = uv[1] - uv[0], t2 = uv[2] - uv[0];
+    float area = e1.x * e2.y - e1.y * e2.x;
+    if (!(std::abs(area) > 1e-6f)) {
+        uv_footprint = 0;
+        return;
     }
+    Vec2f duvdx = (t1 * e2.y - t2 * e1.y) / area;
+    Vec2f duvdy = (t2 * e1.x - t1 * e2.x) / area;
+    uv_footprint = std::sqrt(std::max(duvdx * duvdx, duvdy * duvdy));
+}
 
-    // ====================
-    //   
-    // ====================
-    //   uniform 
-    spec *= specular_intensity;
+PhongShader::PhongShader() : light_dir(0, 0, 1), light_color(1, 1, 1), ambient_color(0, 0, 0), specular_exponent(32.f),
+    specular_intensity(0.f), diffusemap(nullptr), normalmap(nullptr), specularmap(nullptr), light_dir_normalized(0, 0, 1),
+    screen_scale(1, 1) {
+    std::fill(specular_table, specular_table + SPECULAR_TABLE_SIZE + 1, 0.f);
+}
 
-    //  
-    Vec3f ambient = ambient_color;
+void PhongShader::setup_scene(const DrawCall& call, const Vec3f& eye, const Vec3f& center, const Vec3f& light) {
+    bind(call);
+    uniform_M = call.mvp();
+    uniform_MIT = call.mvp().invert_transpose();
 
-    // ====================
-    //   
-    //     
-    // ====================
-    Vec3f diffuse_color(0.8f, 0.8f, 0.8f); //  
+    light_dir = light;
+    light_color = Vec3f(1.0f, 1.0f, 1.0f);
+    ambient_color = Vec3f(0.1f, 0.1f, 0.1f);
 
-    //   :
-    // if (diffusemap && diffusemap->get_width() > 0 && diffusemap->get_height() > 0) {
-    //     // ...     ...
-    // }
+    specular_exponent = 32.0f;
+    specular_intensity = 0.5f;
 
-    //   diffuse_color  
+    view_dir = (center - eye).normalize();
+    camera_pos = eye;
 
-    //  
-    Vec3f result_color;
-    for (int i = 0; i < 3; i++) {
-        result_color[i] = diffuse_color[i] * ambient[i] +
-            diffuse_color[i] * light_color[i] * diff +
-            light_color[i] * spec;
+    diffusemap = &call.model->diffusemap_;
+    normalmap = &call.model->normalmap_;
+    specularmap = &call.model->specularmap_;
+}
 
-        result_color[i] = std::min(1.0f, std::max(0.0f, result_color[i]));
+void PhongShader::prepare() {
+    light_dir_normalized = Vec3f(light_dir).normalize();
+    screen_scale = Vec2f(draw->viewport()[0][0], draw->viewport()[1][1]);
+
+    table_error = 0;
+    if (specular_mode != SPECULAR_TABLE) return;
+    for (int i = 0; i <= SPECULAR_TABLE_SIZE; i++)
+        specular_table[i] = powf((float)i / SPECULAR_TABLE_SIZE, specular_exponent);
+    //      ,   8   
+    for (int i = 0; i < SPECULAR_TABLE_SIZE * 8; i++) {
+        float x = (i + 0.5f) / (SPECULAR_TABLE_SIZE * 8);
+        table_error = std::max(table_error, std::abs(specular(x) - powf(x, specular_exponent)));
     }
-
-    //   TGAColor
-    color = TGAColor(
-        (unsigned char)(result_color[0] * 255),
-        (unsigned char)(result_color[1] * 255),
-        (unsigned char)(result_color[2] * 255),
-        255
-    );
-
-    return false;
-}
\ No newline at end of file
+}
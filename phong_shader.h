@@ -1,21 +1,51 @@
 #ifndef __PHONG_SHADER_H__
 #define __PHONG_SHADER_H__
 
+#include <cmath>
+#include <algorithm>
 #include "tgaimage.h"
 #include "model.h"
 #include "geometry.h"
 #include "our_gl.h"
+#include "light_grid.h"
+#include "texture.h"
+
+//   ,     (. PhongShaderT)
+enum PhongFeatures {
+    PHONG_DIFFUSE_MAP = 1,  //   diffusemap  
+    PHONG_NORMAL_MAP = 2,   //   normalmap (  )
+    PHONG_SPECULAR_MAP = 4  // specularmap   
+};
+
+//    pow(NdotH, specular_exponent) -   
+enum SpecularMode {
+    SPECULAR_POWF,  // powf   
+    SPECULAR_TABLE  //   SPECULAR_TABLE_SIZE    
+};
+
+//    : ,    (   G-)
+struct PhongSurface {
+    Vec3f n;   //  , 
+    Vec2f uv;
+    Vec3f p;   //  
+    float footprint; //     uv -   mip-
+};
 
 class PhongShader : public IShader {
 public:
     // 
-    Matrix uniform_M;     //  * ModelView
+    Matrix uniform_M;     // DrawCall::mvp():  * 
     Matrix uniform_MIT;   //  
     
     // 
     Vec3f light_dir;
     Vec3f light_color;
     Vec3f ambient_color;
+
+    //         .  
+    // light_grid,      ,    lights
+    const std::vector<Light>* lights = nullptr;
+    const LightGrid* light_grid = nullptr;
     
     // 
     Vec3f view_dir;      //  
@@ -24,19 +54,202 @@ public:
     // 
     float specular_exponent;
     float specular_intensity;
+    SpecularMode specular_mode = SPECULAR_POWF;
     
     // 
-    TGAImage* diffusemap;
-    TGAImage* normalmap;
-    TGAImage* specularmap;
+    const Texture* diffusemap;
+    const Texture* normalmap;
+    const Texture* specularmap;
+    TextureFilter texture_filter = FILTER_TRILINEAR;
     
-    //  
-    mat<3, 3, float> varying_tri;   //     
-    mat<3, 3, float> varying_nrm;   //  
-    mat<3, 2, float> varying_uv;    // UV 
+    // varying-   : uv (2),  (3),  (3),
+    //   
+    enum { VARYING_SIZE = 8 };
+    float varying[3][VARYING_SIZE];
+
+    //  main()   : bind(),   call,  ,
+    //  ( , , )   .  (specular_mode,
+    // )   ,  prepare()
+    void setup_scene(const DrawCall& call, const Vec3f& eye, const Vec3f& center, const Vec3f& light);
+    //   +z, ,    ;     prepare()
+    PhongShader();
+
+    //  light_dir      SPECULAR_TABLE
+    virtual void prepare();
+    //      powf ( prepare())
+    float specular_table_error() const { return table_error; }
     
     virtual Vec4f vertex(int iface, int nthvert);
-    virtual bool fragment(Vec3f bar, TGAColor& color);
+    virtual bool fragment(Vec3f bar, TGAColor& color) { return shade<0>(bar, color); } //  
+    virtual IShader* clone() const { return new PhongShader(*this); }
+
+    virtual int varying_size() const { return VARYING_SIZE; }
+    virtual Vec4f vertex_indexed(int ivert, float* varyings);
+    virtual void set_varyings(int nthvert, const float* varyings);
+    virtual void vertex_batch(int begin, int end, Vec4f* pts, float* varyings); //  transform_vertices()
+
+    //  ; Features -  PhongFeatures,  
+    //  .  ,    triangle<Shader>()
+    template <unsigned Features> bool shade(Vec3f bar, TGAColor& color) {
+        color = light<Features>(surface(bar));
+        return false;
+    }
+
+    //         :
+    //  varying-    
+    PhongSurface surface(Vec3f bar) const;
+    template <unsigned Features> TGAColor light(const PhongSurface& s) const;
+
+    static const int SPECULAR_TABLE_SIZE = 1024;
+
+private:
+    //   prepare()
+    Vec3f light_dir_normalized;
+    float specular_table[SPECULAR_TABLE_SIZE + 1];
+    float table_error = 0;
+
+    float specular(float NdotH) const {
+        if (specular_mode == SPECULAR_POWF) return powf(NdotH, specular_exponent);
+        float t = NdotH * SPECULAR_TABLE_SIZE;
+        //    int: NaN ( )    
+        if (!(t > 0)) return specular_table[0];
+        if (t >= SPECULAR_TABLE_SIZE) return specular_table[SPECULAR_TABLE_SIZE];
+        int i = (int)t;
+        return specular_table[i] + (specular_table[i + 1] - specular_table[i]) * (t - i);
+    }
+
+    //    (  )     
+    Vec3f local_light(const Light& l, const PhongSurface& s, const Vec3f& n, const Vec3f& to_camera,
+        const Vec3f& diffuse_color, float spec_scale) const;
+
+    // uv     (   ),
+    //   uv       
+    //  set_varyings()    -     2x2
+    Vec2f screen_scale;  // Viewport: NDC -> 
+    float uv_footprint = 0;
+    void update_footprint();
+
+    Vec3f sample(const Texture* map, const PhongSurface& s) const {
+        return map->sample(s.uv, map->lod(s.footprint), texture_filter);
+    }
+    static bool has_map(const Texture* map) { return map && !map->empty(); }
 };
 
-#endif //__PHONG_SHADER_H__
\ No newline at end of file
+//      ,    .
+// fragment() final,  triangle<PhongShaderT<F> >()     
+template <unsigned Features> class PhongShaderT : public PhongShader {
+public:
+    virtual bool fragment(Vec3f bar, TGAColor& color) final { return shade<Features>(bar, color); }
+    virtual IShader* clone() const { return new PhongShaderT(*this); }
+};
+
+inline PhongSurface PhongShader::surface(Vec3f bar) const {
+    //  varying-  ,      ,   
+    //    uv,   
+    float v[VARYING_SIZE];
+    for (int k = 0; k < VARYING_SIZE; k++) v[k] = varying[0][k] * bar[0];
+    for (int i = 1; i < 3; i++)
+        for (int k = 0; k < VARYING_SIZE; k++) v[k] += varying[i][k] * bar[i];
+
+    PhongSurface s;
+    s.uv = Vec2f(v[0], v[1]);
+    s.n = Vec3f(v[2], v[3], v[4]).normalize();
+    s.p = Vec3f(v[5], v[6], v[7]);
+    s.footprint = uv_footprint;
+    return s;
+}
+
+template <unsigned Features> inline TGAColor PhongShader::light(const PhongSurface& s) const {
+    Vec3f n = s.n;
+    if ((Features & PHONG_NORMAL_MAP) && has_map(normalmap)) {
+        Vec3f nm = sample(normalmap, s) * 2.f - Vec3f(1, 1, 1);
+        n = proj<3>(uniform_MIT * embed<4>(nm, 0.f)).normalize();
+    }
+
+    //  
+    Vec3f to_camera = (camera_pos - s.p).normalize();
+
+    //  
+    float NdotL = std::max(0.0f, n * light_dir_normalized);
+    float diff = NdotL;
+
+    //  
+    float spec = 0.0f;
+    if (diff > 0) {
+        Vec3f half_vector = (light_dir_normalized + to_camera).normalize();
+        float NdotH = std::max(0.0f, n * half_vector);
+        spec = specular(NdotH);
+    }
+    spec *= specular_intensity;
+    float spec_scale = specular_intensity; //   
+    if ((Features & PHONG_SPECULAR_MAP) && has_map(specularmap)) {
+        float m = sample(specularmap, s).z;
+        spec *= m;
+        spec_scale *= m;
+    }
+
+    //  
+    Vec3f ambient = ambient_color;
+
+    //    -   
+    Vec3f diffuse_color(0.8f, 0.8f, 0.8f);
+    if ((Features & PHONG_DIFFUSE_MAP) && has_map(diffusemap)) {
+        diffuse_color = sample(diffusemap, s);
+    }
+
+    //  
+    Vec3f local(0, 0, 0);
+    if (lights) {
+        if (light_grid) {
+            for (int i : light_grid->lights_at(s.p)) local = local + local_light((*lights)[i], s, n, to_camera, diffuse_color, spec_scale);
+        }
+        else {
+            for (const Light& l : *lights) local = local + local_light(l, s, n, to_camera, diffuse_color, spec_scale);
+        }
+    }
+
+    //  
+    Vec3f result_color;
+    for (int i = 0; i < 3; i++) {
+        result_color[i] = diffuse_color[i] * ambient[i] +
+            diffuse_color[i] * light_color[i] * diff +
+            light_color[i] * spec + local[i];
+
+        result_color[i] = std::min(1.0f, std::max(0.0f, result_color[i]));
+    }
+
+    //   TGAColor
+    return TGAColor(
+        (unsigned char)(result_color[0] * 255),
+        (unsigned char)(result_color[1] * 255),
+        (unsigned char)(result_color[2] * 255),
+        255
+    );
+}
+
+inline Vec3f PhongShader::local_light(const Light& l, const PhongSurface& s, const Vec3f& n, const Vec3f& to_camera,
+    const Vec3f& diffuse_color, float spec_scale) const {
+    Vec3f d = l.position - s.p;
+    float dist2 = d * d;
+    float r2 = l.radius * l.radius;
+    if (!(dist2 < r2) || dist2 <= 0) return Vec3f(0, 0, 0);
+    Vec3f to_light = d / std::sqrt(dist2);
+
+    //  (1 - d^2/r^2)^2:    
+    float k = 1.f - dist2 / r2;
+    float attenuation = k * k;
+    if (l.type == LIGHT_SPOT) {
+        float cone = (-(to_light * l.direction) - l.cos_outer) / (l.cos_inner - l.cos_outer);
+        attenuation *= std::min(1.f, std::max(0.f, cone));
+    }
+    float NdotL = n * to_light;
+    if (attenuation <= 0 || NdotL <= 0) return Vec3f(0, 0, 0);
+
+    Vec3f half_vector = (to_light + to_camera).normalize();
+    float spec = specular(std::max(0.0f, n * half_vector)) * spec_scale;
+    Vec3f c;
+    for (int i = 0; i < 3; i++) c[i] = l.color[i] * (diffuse_color[i] * NdotL + spec) * attenuation;
+    return c;
+}
+
+#endif //__PHONG_SHADER_H__
@@ -0,0 +1,183 @@
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <limits>
+#include "raster_kernel.h"
+#include "simd.h"
+
+bool TriangleSetup::init(Vec4f* pts) {
+    for (int i = 0; i < 3; i++) {
+        v[i] = Vec2f(pts[i][0] / pts[i][3], pts[i][1] / pts[i][3]);
+        z[i] = pts[i][2];
+        w[i] = pts[i][3];
+    }
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if (!(std::abs(area) > 1e-2)) return false; //  
+    for (int i = 0; i < 3; i++) {
+        //   i- 
+        const Vec2f& p = v[(i + 1) % 3];
+        const Vec2f& q = v[(i + 2) % 3];
+        a[i] = -(q.y - p.y) / area;
+        b[i] = (q.x - p.x) / area;
+        c[i] = ((q.y - p.y) * p.x - (q.x - p.x) * p.y) / area;
+    }
+    return true;
+}
+
+// ======================
+//  .    SIMD-,
+//      
+// ======================
+static void span_scalar(const TriangleSetup& tri, int x, int y, int n, const float* zrow, SpanResult& out) {
+    float base[3];
+    for (int i = 0; i < 3; i++) base[i] = tri.edge(i, (float)x, (float)y);
+
+    out.mask = 0;
+    for (int k = 0; k < n; k++) {
+        float c[3];
+        for (int i = 0; i < 3; i++) {
+            c[i] = base[i] + tri.a[i] * (float)k;
+            out.bar[i][k] = c[i];
+        }
+        //  / 
+        if (c[0] < 0 || c[1] < 0 || c[2] < 0) continue;
+
+        float z = tri.z[0] * c[0] + tri.z[1] * c[1] + tri.z[2] * c[2];
+        float w = tri.w[0] * c[0] + tri.w[1] * c[1] + tri.w[2] * c[2];
+        float depth = z / w;
+        out.depth[k] = depth;
+
+        //  
+        if (zrow[k] <= depth) out.mask |= 1u << k;
+    }
+}
+
+#ifdef KG3_X86
+
+// z-   8 ;      ,
+//  +inf,       
+static const float* span_zbuffer(const float* zrow, int n, float* tmp) {
+    if (n >= RASTER_SPAN) return zrow;
+    for (int k = 0; k < RASTER_SPAN; k++) tmp[k] = k < n ? zrow[k] : std::numeric_limits<float>::infinity();
+    return tmp;
+}
+
+KG3_TARGET("sse2")
+static void span_sse2(const TriangleSetup& tri, int x, int y, int n, const float* zrow, SpanResult& out) {
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 a[3], base[3];
+    for (int i = 0; i < 3; i++) {
+        a[i] = _mm_set1_ps(tri.a[i]);
+        base[i] = _mm_set1_ps(tri.edge(i, (float)x, (float)y));
+    }
+    __m128 z0 = _mm_set1_ps(tri.z[0]), z1 = _mm_set1_ps(tri.z[1]), z2 = _mm_set1_ps(tri.z[2]);
+    __m128 w0 = _mm_set1_ps(tri.w[0]), w1 = _mm_set1_ps(tri.w[1]), w2 = _mm_set1_ps(tri.w[2]);
+
+    float tmp[RASTER_SPAN];
+    const float* zb = span_zbuffer(zrow, n, tmp);
+
+    unsigned mask = 0;
+    for (int h = 0; h < 2; h++) {
+        __m128 lane = _mm_setr_ps(4.f * h, 4.f * h + 1, 4.f * h + 2, 4.f * h + 3);
+        __m128 c[3];
+        for (int i = 0; i < 3; i++) {
+            c[i] = _mm_add_ps(base[i], _mm_mul_ps(a[i], lane));
+            _mm_storeu_ps(out.bar[i] + 4 * h, c[i]);
+        }
+        __m128 outside = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(c[0], zero), _mm_cmplt_ps(c[1], zero)), _mm_cmplt_ps(c[2], zero));
+
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(z0, c[0]), _mm_mul_ps(z1, c[1])), _mm_mul_ps(z2, c[2]));
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, c[0]), _mm_mul_ps(w1, c[1])), _mm_mul_ps(w2, c[2]));
+        __m128 depth = _mm_div_ps(z, w);
+        _mm_storeu_ps(out.depth + 4 * h, depth);
+
+        // cmple   NaN,      
+        __m128 pass = _mm_andnot_ps(outside, _mm_cmple_ps(_mm_loadu_ps(zb + 4 * h), depth));
+        mask |= (unsigned)_mm_movemask_ps(pass) << (4 * h);
+    }
+    out.mask = mask & ((1u << n) - 1);
+}
+
+KG3_TARGET("avx2")
+static void span_avx2(const TriangleSetup& tri, int x, int y, int n, const float* zrow, SpanResult& out) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256 c[3];
+    for (int i = 0; i < 3; i++) {
+        __m256 base = _mm256_set1_ps(tri.edge(i, (float)x, (float)y));
+        c[i] = _mm256_add_ps(base, _mm256_mul_ps(_mm256_set1_ps(tri.a[i]), lane));
+        _mm256_storeu_ps(out.bar[i], c[i]);
+    }
+    __m256 outside = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(c[0], zero, _CMP_LT_OQ), _mm256_cmp_ps(c[1], zero, _CMP_LT_OQ)),
+        _mm256_cmp_ps(c[2], zero, _CMP_LT_OQ));
+
+    __m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.z[0]), c[0]), _mm256_mul_ps(_mm256_set1_ps(tri.z[1]), c[1])),
+        _mm256_mul_ps(_mm256_set1_ps(tri.z[2]), c[2]));
+    __m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.w[0]), c[0]), _mm256_mul_ps(_mm256_set1_ps(tri.w[1]), c[1])),
+        _mm256_mul_ps(_mm256_set1_ps(tri.w[2]), c[2]));
+    __m256 depth = _mm256_div_ps(z, w);
+    _mm256_storeu_ps(out.depth, depth);
+
+    float tmp[RASTER_SPAN];
+    __m256 zb = _mm256_loadu_ps(span_zbuffer(zrow, n, tmp));
+    __m256 pass = _mm256_andnot_ps(outside, _mm256_cmp_ps(zb, depth, _CMP_LE_OQ));
+    out.mask = (unsigned)_mm256_movemask_ps(pass) & ((1u << n) - 1);
+}
+
+#endif // KG3_X86
+
+// ======================
+//  
+// ======================
+struct KernelEntry {
+    const char* name;
+    SpanKernel fn;
+};
+
+static KernelEntry detect_kernel() {
+#ifdef KG3_X86
+    if (cpu_has_avx2()) return KernelEntry{ "avx2", span_avx2 };
+    if (cpu_has_sse2()) return KernelEntry{ "sse2", span_sse2 };
+#endif
+    return KernelEntry{ "scalar", span_scalar };
+}
+
+static KernelEntry forced_kernel = { nullptr, nullptr };
+
+static const KernelEntry& current_kernel() {
+    static const KernelEntry best = detect_kernel();
+    return forced_kernel.fn ? forced_kernel : best;
+}
+
+SpanKernel span_kernel() {
+    return current_kernel().fn;
+}
+
+const char* span_kernel_name() {
+    return current_kernel().name;
+}
+
+bool set_span_kernel(const char* name) {
+    std::string s(name);
+    if (s == "auto") {
+        forced_kernel = KernelEntry{ nullptr, nullptr };
+        return true;
+    }
+    if (s == "scalar") {
+        forced_kernel = KernelEntry{ "scalar", span_scalar };
+        return true;
+    }
+#ifdef KG3_X86
+    if (s == "sse2" && cpu_has_sse2()) {
+        forced_kernel = KernelEntry{ "sse2", span_sse2 };
+        return true;
+    }
+    if (s == "avx2" && cpu_has_avx2()) {
+        forced_kernel = KernelEntry{ "avx2", span_avx2 };
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,37 @@
+#ifndef __RASTER_KERNEL_H__
+#define __RASTER_KERNEL_H__
+
+#include "geometry.h"
+
+const int RASTER_BLOCK = 8; //  8x8   
+const int RASTER_SPAN = 8;  //   ,     
+
+//  :       
+//     ,   E_i(x, y) = a_i*x + b_i*y + c_i
+//     i- 
+struct TriangleSetup {
+    Vec2f v[3];              //    
+    float a[3], b[3], c[3];  //   
+    float z[3], w[3];        // z  w    
+
+    bool init(Vec4f* pts);
+    float edge(int i, float x, float y) const { return a[i] * x + b[i] * y + c[i]; }
+};
+
+//       n <= RASTER_SPAN 
+struct SpanResult {
+    float bar[3][RASTER_SPAN]; //    
+    float depth[RASTER_SPAN];  //  z/w
+    unsigned mask;             //  k:  x+k      
+};
+
+// zrow    (x, y)  DepthBuffer
+typedef void (*SpanKernel)(const TriangleSetup& tri, int x, int y, int n, const float* zrow, SpanResult& out);
+
+//        (AVX2 -> SSE2 -> ).
+//      .
+SpanKernel span_kernel();
+const char* span_kernel_name();
+bool set_span_kernel(const char* name); // "scalar", "sse2", "avx2"  "auto"
+
+#endif //__RASTER_KERNEL_H__
@@ -0,0 +1,234 @@
+#ifndef __RASTERIZER_H__
+#define __RASTERIZER_H__
+
+#include <limits>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include "our_gl.h"
+#include "raster_kernel.h"
+
+//   .  - draw_triangle(): ,  
+//   ;      ,  Output:
+//   bool out(int x, int y, Vec3f bar) - true,   ,
+//     z-   .
+// triangle<Shader>() -     Shader::fragment(). triangle<IShader>() -
+//    fragment()    (  triangle()  our_gl.h);
+//       final fragment()    :
+// triangle<PhongShaderT<...> >(...).  Output -  G- (gbuffer.h)
+//    (depth_triangle(),  ).
+//
+//   :     depth_triangle(),
+//          triangle<Shader>().   
+//          ,   ,
+//   "  "        
+// :       (   ),
+//    ,    .
+//
+//   z-   Z (DepthBuffer::enable_hiz), 
+//          .
+
+static_assert(DepthBuffer::HIZ_BLOCK == RASTER_BLOCK, "Hi-Z blocks must match rasterizer blocks");
+
+//    
+template <class Shader> struct ColorOutput {
+    Shader& shader;
+    TGAImage& image;
+    int bytespp;
+
+    ColorOutput(Shader& shader, TGAImage& image) : shader(shader), image(image), bytespp(image.get_bytespp()) {}
+    bool operator()(int x, int y, Vec3f bar) {
+        TGAColor color;
+        if (shader.fragment(bar, color)) return true;
+        memcpy(image.scanline(y) + x * bytespp, color.bgra, bytespp);
+        return false;
+    }
+};
+
+//  ,  :   
+//     ,     varying-
+template <class Output> struct ClippedOutput {
+    Output& inner;
+    Vec3f bar[3];
+
+    ClippedOutput(Output& inner) : inner(inner) {}
+    bool operator()(int x, int y, Vec3f c) {
+        return inner(x, y, bar[0] * c.x + bar[1] * c.y + bar[2] * c.z);
+    }
+};
+
+//  
+struct DepthOutput {
+    bool operator()(int, int, Vec3f) { return false; }
+};
+
+template <class Output> void rasterize(Vec4f* pts, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax, Output& out);
+
+template <class Output> void draw_triangle(Vec4f* pts, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax, Output& out) {
+    ClippedPolygon poly;
+    ClipResult clip = clip_triangle(pts, zbuffer.get_width(), zbuffer.get_height(), poly);
+    if (clip == CLIP_REJECTED) return;
+    if (clip == CLIP_INSIDE) {
+        rasterize(pts, zbuffer, clipmin, clipmax, out);
+        return;
+    }
+
+    //     -  
+    ClippedOutput<Output> clipped(out);
+    for (int i = 1; i + 1 < poly.n; i++) {
+        Vec4f tri[3] = { poly.pts[0], poly.pts[i], poly.pts[i + 1] };
+        clipped.bar[0] = poly.bar[0];
+        clipped.bar[1] = poly.bar[i];
+        clipped.bar[2] = poly.bar[i + 1];
+        rasterize(tri, zbuffer, clipmin, clipmax, clipped);
+    }
+}
+
+template <class Shader> void triangle(Vec4f* pts, Shader& shader, TGAImage& image, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax) {
+    assert(image.get_width() == zbuffer.get_width() && image.get_height() == zbuffer.get_height());
+    ColorOutput<Shader> out(shader, image);
+    draw_triangle(pts, zbuffer, clipmin, clipmax, out);
+}
+
+inline void depth_triangle(Vec4f* pts, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax) {
+    DepthOutput out;
+    draw_triangle(pts, zbuffer, clipmin, clipmax, out);
+}
+
+inline void depth_triangle(Vec4f* pts, DepthBuffer& zbuffer) {
+    depth_triangle(pts, zbuffer, Vec2i(0, 0), Vec2i(zbuffer.get_width() - 1, zbuffer.get_height() - 1));
+}
+
+template <class Shader> void triangle(Vec4f* pts, Shader& shader, TGAImage& image, DepthBuffer& zbuffer) {
+    triangle<Shader>(pts, shader, image, zbuffer, Vec2i(0, 0), Vec2i(image.get_width() - 1, image.get_height() - 1));
+}
+
+//    z- 
+template <class Shader> void triangle(Vec4f* pts, Shader& shader, const RenderContext& context) {
+    triangle<Shader>(pts, shader, *context.image, *context.zbuffer);
+}
+
+template <class Output> void rasterize(Vec4f* pts, DepthBuffer& zbuffer, Vec2i clipmin, Vec2i clipmax, Output& out) {
+    TriangleSetup tri;
+    if (!tri.init(pts)) return;
+
+    Vec2f bboxmin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            bboxmin[j] = std::min(bboxmin[j], tri.v[i][j]);
+            bboxmax[j] = std::max(bboxmax[j], tri.v[i][j]);
+        }
+    }
+
+    //  bounding box  (  -  )
+    bboxmin.x = std::max((float)clipmin.x, std::min((float)clipmax.x, bboxmin.x));
+    bboxmin.y = std::max((float)clipmin.y, std::min((float)clipmax.y, bboxmin.y));
+    bboxmax.x = std::max((float)clipmin.x, std::min((float)clipmax.x, bboxmax.x));
+    bboxmax.y = std::max((float)clipmin.y, std::min((float)clipmax.y, bboxmax.y));
+
+    int xmin = (int)bboxmin.x, ymin = (int)bboxmin.y;
+    int xmax = (int)bboxmax.x, ymax = (int)bboxmax.y;
+
+    //  Z.    -   z/w 
+    // ( w_i*c_i ),      ;
+    //     
+    bool hiz = zbuffer.hiz_enabled();
+    float zfar_limit = 0;
+    if (hiz) {
+        float zmax = -std::numeric_limits<float>::max(), zabs = 0;
+        for (int i = 0; i < 3; i++) {
+            float zi = tri.z[i] / tri.w[i];
+            zmax = std::max(zmax, zi);
+            zabs = std::max(zabs, std::abs(zi));
+        }
+        zfar_limit = zmax + zabs * 1e-5f + 1e-30f;
+
+        //      64x64   bounding box
+        const int group = RASTER_BLOCK * DepthBuffer::HIZ_GROUP;
+        bool visible = false;
+        for (int gy = ymin / group; gy <= ymax / group && !visible; gy++)
+            for (int gx = xmin / group; gx <= xmax / group && !visible; gx++)
+                visible = !(zfar_limit < zbuffer.hiz_group(gx, gy));
+        if (!visible) {
+            zbuffer.stats().hiz_triangles++;
+            return;
+        }
+    }
+
+    SpanKernel kernel = span_kernel();
+    SpanResult span;
+
+    //     ,    bounding box:  
+    //          ,  
+    int gx0 = xmin - xmin % RASTER_BLOCK;
+    int ncols = (xmax - gx0) / RASTER_BLOCK + 1;
+    static thread_local std::vector<unsigned char> live; //  ,   
+    static thread_local std::vector<unsigned char> changed; // ,    -  Hi-Z
+    live.resize(ncols);
+    changed.resize(ncols);
+    long long fragments = 0, hiz_blocks = 0;
+
+    //   :   8 ,      ,
+    //        
+    for (int gy = ymin - ymin % RASTER_BLOCK; gy <= ymax; gy += RASTER_BLOCK) {
+        int by = std::max(gy, ymin);
+        int ey = std::min(gy + RASTER_BLOCK - 1, ymax);
+
+        //   ,          
+        bool any = false;
+        for (int col = 0; col < ncols; col++) {
+            int bx = std::max(gx0 + col * RASTER_BLOCK, xmin);
+            int ex = std::min(gx0 + col * RASTER_BLOCK + RASTER_BLOCK - 1, xmax);
+            bool outside = false;
+            for (int i = 0; i < 3 && !outside; i++) {
+                float emax = tri.edge(i, (float)bx, (float)by)
+                    + std::max(0.f, tri.a[i]) * (ex - bx)
+                    + std::max(0.f, tri.b[i]) * (ey - by);
+                outside = emax < 0;
+            }
+            if (!outside && hiz && zfar_limit < zbuffer.hiz_block((gx0 / RASTER_BLOCK) + col, gy / RASTER_BLOCK)) {
+                outside = true;
+                hiz_blocks++;
+            }
+            live[col] = !outside;
+            changed[col] = 0;
+            any = any || !outside;
+        }
+        if (!any) continue;
+
+        for (int y = by; y <= ey; y++) {
+            float* zrow = zbuffer.row(y);
+            for (int col = 0; col < ncols; col++) {
+                if (!live[col]) continue;
+                int bx = std::max(gx0 + col * RASTER_BLOCK, xmin);
+                int ex = std::min(gx0 + col * RASTER_BLOCK + RASTER_BLOCK - 1, xmax);
+
+                // ,     -    ,
+                //     ,   
+                int n = ex - bx + 1;
+                kernel(tri, bx, y, n, zrow + bx, span);
+                for (int k = 0; k < n; k++) {
+                    if (!(span.mask >> k & 1)) continue;
+                    Vec3f c(span.bar[0][k], span.bar[1][k], span.bar[2][k]);
+                    if (out(bx + k, y, c)) continue;
+                    fragments++;
+                    if (zrow[bx + k] != span.depth[k]) changed[col] = 1;
+                    zrow[bx + k] = span.depth[k];
+                }
+            }
+        }
+
+        if (hiz) {
+            for (int col = 0; col < ncols; col++)
+                if (changed[col]) zbuffer.hiz_update_block(gx0 / RASTER_BLOCK + col, gy / RASTER_BLOCK);
+        }
+    }
+
+    DepthBuffer::Stats& stats = zbuffer.stats();
+    if (fragments) stats.fragments += fragments;
+    if (hiz_blocks) stats.hiz_blocks += hiz_blocks;
+}
+
+#endif //__RASTERIZER_H__
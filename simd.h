@@ -0,0 +1,49 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+//   SIMD-:  intrinsics,  target   CPU
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KG3_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang  SIMD-       
+#if defined(__GNUC__)
+#define KG3_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KG3_TARGET(isa)
+#endif
+
+#ifdef KG3_X86
+
+inline bool cpu_has_sse2() {
+#if defined(_MSC_VER)
+    return true; // x64  /arch:SSE2  
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+inline bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false; //   YMM-
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // KG3_X86
+
+#endif //__SIMD_H__
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <algorithm>
+#include "texture.h"
+
+Texture::Texture() : levels_() {
+}
+
+void Texture::init_level(Level& l, int w, int h) {
+    l.width = w;
+    l.height = h;
+    l.blocks_x = (w + 3) / 4;
+    l.texels.assign((size_t)l.blocks_x * ((h + 3) / 4) * 16, 0);
+}
+
+static uint32_t pack(const unsigned char* bgra) {
+    return (uint32_t)bgra[0] | (uint32_t)bgra[1] << 8 | (uint32_t)bgra[2] << 16 | (uint32_t)bgra[3] << 24;
+}
+
+static unsigned char channel(uint32_t t, int c) {
+    return (unsigned char)(t >> (8 * c));
+}
+
+void Texture::build(TGAImage& img) {
+    levels_.clear();
+    int w = img.get_width(), h = img.get_height(), bpp = img.get_bytespp();
+    if (w <= 0 || h <= 0 || !img.buffer()) return;
+
+    levels_.push_back(Level());
+    init_level(levels_[0], w, h);
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row = img.scanline(y);
+        for (int x = 0; x < w; x++) {
+            const unsigned char* p = row + x * bpp;
+            unsigned char bgra[4] = { p[0], p[0], p[0], 255 }; //  -   
+            if (bpp >= 3) {
+                bgra[1] = p[1];
+                bgra[2] = p[2];
+            }
+            if (bpp == 4) bgra[3] = p[3];
+            levels_[0].at(x, y) = pack(bgra);
+        }
+    }
+
+    //   -  2x2;      () 
+    while (w > 1 || h > 1) {
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        levels_.push_back(Level());
+        const Level& src = levels_[levels_.size() - 2];
+        Level& dst = levels_.back();
+        init_level(dst, nw, nh);
+        for (int y = 0; y < nh; y++) {
+            int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+            for (int x = 0; x < nw; x++) {
+                int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                uint32_t t[4] = { src.at(x0, y0), src.at(x1, y0), src.at(x0, y1), src.at(x1, y1) };
+                unsigned char bgra[4];
+                for (int c = 0; c < 4; c++)
+                    bgra[c] = (unsigned char)((channel(t[0], c) + channel(t[1], c) + channel(t[2], c) + channel(t[3], c) + 2) / 4);
+                dst.at(x, y) = pack(bgra);
+            }
+        }
+        w = nw;
+        h = nh;
+    }
+}
+
+float Texture::lod(float footprint) const {
+    if (empty() || !(footprint > 0)) return 0;
+    return std::log2(footprint * std::max(width(), height()));
+}
+
+static Vec3f to_rgb(uint32_t t) {
+    return Vec3f(channel(t, 2), channel(t, 1), channel(t, 0)) * (1.f / 255.f);
+}
+
+//    ; x -    [-1, size]
+static int wrap(int x, int size) {
+    if (x < 0) return x + size;
+    if (x >= size) return x - size;
+    return x;
+}
+
+Vec3f Texture::nearest(const Level& l, Vec2f uv) const {
+    float u = uv.x - std::floor(uv.x), v = uv.y - std::floor(uv.y);
+    int x = std::min((int)(u * l.width), l.width - 1);
+    int y = std::min((int)(v * l.height), l.height - 1);
+    return to_rgb(l.at(x, y));
+}
+
+Vec3f Texture::bilinear(const Level& l, Vec2f uv) const {
+    //   i -  (i + 0.5) / size
+    float u = (uv.x - std::floor(uv.x)) * l.width - 0.5f;
+    float v = (uv.y - std::floor(uv.y)) * l.height - 0.5f;
+    float fx = std::floor(u), fy = std::floor(v);
+    int x0 = wrap((int)fx, l.width), x1 = wrap((int)fx + 1, l.width);
+    int y0 = wrap((int)fy, l.height), y1 = wrap((int)fy + 1, l.height);
+    float ax = u - fx, ay = v - fy;
+    Vec3f top = to_rgb(l.at(x0, y0)) * (1 - ax) + to_rgb(l.at(x1, y0)) * ax;
+    Vec3f bottom = to_rgb(l.at(x0, y1)) * (1 - ax) + to_rgb(l.at(x1, y1)) * ax;
+    return top * (1 - ay) + bottom * ay;
+}
+
+Vec3f Texture::sample(Vec2f uv, float lod, TextureFilter filter) const {
+    if (empty() || !std::isfinite(uv.x) || !std::isfinite(uv.y)) return Vec3f(0, 0, 0);
+    int last = levels() - 1;
+    lod = std::max(0.f, std::min((float)last, lod));
+    if (filter == FILTER_TRILINEAR) {
+        int l0 = (int)lod;
+        float t = lod - l0;
+        Vec3f c = bilinear(levels_[l0], uv);
+        if (t > 0 && l0 < last) c = c * (1 - t) + bilinear(levels_[l0 + 1], uv) * t;
+        return c;
+    }
+    const Level& l = levels_[(int)(lod + 0.5f)];
+    return filter == FILTER_BILINEAR ? bilinear(l, uv) : nearest(l, uv);
+}
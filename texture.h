@@ -0,0 +1,59 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <vector>
+#include <cstdint>
+#include "geometry.h"
+#include "tgaimage.h"
+
+enum TextureFilter {
+    FILTER_NEAREST,   //    round(lod)
+    FILTER_BILINEAR,  // 4   round(lod)
+    FILTER_TRILINEAR  //           lod
+};
+
+//     :  mip-   ,
+//    4x4 (64  -   ),  -  .
+//   u   v        ,  
+//  TGAImage.   (wrap), uv = (0, 0) -  .
+class Texture {
+public:
+    Texture();
+
+    //     0      2x2.
+    //      ,    uv
+    void build(TGAImage& img);
+    bool empty() const { return levels_.empty(); }
+
+    int levels() const { return (int)levels_.size(); }
+    int width(int level = 0) const { return levels_[level].width; }
+    int height(int level = 0) const { return levels_[level].height; }
+
+    // footprint -      uv (  du/dx, du/dy);
+    // lod = log2(footprint *  )
+    float lod(float footprint) const;
+
+    //  RGB  [0, 1];       
+    Vec3f sample(Vec2f uv, float lod, TextureFilter filter) const;
+
+private:
+    struct Level {
+        int width, height;
+        int blocks_x;                  //  4x4  
+        std::vector<uint32_t> texels;  // BGRA,  4x4
+        uint32_t at(int x, int y) const {
+            return texels[((size_t)(y >> 2) * blocks_x + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)];
+        }
+        uint32_t& at(int x, int y) {
+            return texels[((size_t)(y >> 2) * blocks_x + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)];
+        }
+    };
+
+    static void init_level(Level& l, int w, int h);
+    Vec3f nearest(const Level& l, Vec2f uv) const;
+    Vec3f bilinear(const Level& l, Vec2f uv) const;
+
+    std::vector<Level> levels_;
+};
+
+#endif //__TEXTURE_H__
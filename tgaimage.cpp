@@ -3,30 +3,49 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "tgaimage.h"
+#include "mapped_file.h"
 
-TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
+TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0), mapped(NULL) {
 }
 
-TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp) {
+TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp), mapped(NULL) {
     unsigned long nbytes = width * height * bytespp;
     data = new unsigned char[nbytes];
     memset(data, 0, nbytes);
 }
 
-TGAImage::TGAImage(const TGAImage& img) : data(NULL), width(img.width), height(img.height), bytespp(img.bytespp) {
+TGAImage::TGAImage(const TGAImage& img) : data(NULL), width(img.width), height(img.height), bytespp(img.bytespp), mapped(NULL) {
     unsigned long nbytes = width * height * bytespp;
     data = new unsigned char[nbytes];
     memcpy(data, img.data, nbytes);
 }
 
+TGAImage::TGAImage(TGAImage&& img) : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp), mapped(img.mapped) {
+    img.data = NULL;
+    img.mapped = NULL;
+    img.width = img.height = img.bytespp = 0;
+}
+
 TGAImage::~TGAImage() {
-    if (data) delete[] data;
+    release();
+}
+
+void TGAImage::release() {
+    if (mapped) delete mapped;
+    else if (data) delete[] data;
+    mapped = NULL;
+    data = NULL;
 }
 
 TGAImage& TGAImage::operator =(const TGAImage& img) {
     if (this != &img) {
-        if (data) delete[] data;
+        release();
         width = img.width;
         height = img.height;
         bytespp = img.bytespp;
@@ -37,9 +56,23 @@ TGAImage& TGAImage::operator =(const TGAImage& img) {
     return *this;
 }
 
-bool TGAImage::read_tga_file(const char* filename) {
-    if (data) delete[] data;
-    data = NULL;
+TGAImage& TGAImage::operator =(TGAImage&& img) {
+    if (this != &img) {
+        release();
+        data = img.data;
+        mapped = img.mapped;
+        width = img.width;
+        height = img.height;
+        bytespp = img.bytespp;
+        img.data = NULL;
+        img.mapped = NULL;
+        img.width = img.height = img.bytespp = 0;
+    }
+    return *this;
+}
+
+bool TGAImage::read_tga_file(const char* filename, bool bottom_up) {
+    release();
     std::ifstream in;
     in.open(filename, std::ios::binary);
     if (!in.is_open()) {
@@ -64,8 +97,16 @@ bool TGAImage::read_tga_file(const char* filename) {
     }
     unsigned long nbytes = bytespp * width * height;
     data = new unsigned char[nbytes];
+    // rows are stored bottom-up unless the origin bit is set
+    bool file_top_down = (header.imagedescriptor & 0x20) != 0;
+    bool flip = file_top_down == bottom_up;
     if (3 == header.datatypecode || 2 == header.datatypecode) {
-        in.read((char*)data, nbytes);
+        if (!flip) in.read((char*)data, nbytes);
+        else {
+            unsigned long bytes_per_line = width * bytespp;
+            for (int y = 0; y < height && in.good(); y++)
+                in.read((char*)data + (height - 1 - y) * bytes_per_line, bytes_per_line);
+        }
         if (!in.good()) {
             in.close();
             std::cerr << "an error occured while reading the data\n";
@@ -73,7 +114,7 @@ bool TGAImage::read_tga_file(const char* filename) {
         }
     }
     else if (10 == header.datatypecode || 11 == header.datatypecode) {
-        if (!load_rle_data(in)) {
+        if (!load_rle_data(in, flip)) {
             in.close();
             std::cerr << "an error occured while reading the data\n";
             return false;
@@ -84,9 +125,6 @@ bool TGAImage::read_tga_file(const char* filename) {
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
-    if (!(header.imagedescriptor & 0x20)) {
-        flip_vertically();
-    }
     if (header.imagedescriptor & 0x10) {
         flip_horizontally();
     }
@@ -95,11 +133,57 @@ bool TGAImage::read_tga_file(const char* filename) {
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream& in) {
+bool TGAImage::map_tga_file(const char* filename, bool bottom_up) {
+    release();
+    MappedFile* file = new MappedFile();
+    TGA_Header header;
+    if (!file->open(filename, true) || file->size() < sizeof(header)) {
+        delete file;
+        return false;
+    }
+    memcpy(&header, file->data(), sizeof(header));
+    int w = header.width, h = header.height, bpp = header.bitsperpixel >> 3;
+    size_t offset = sizeof(header) + (unsigned char)header.idlength;
+    bool raw = 2 == header.datatypecode || 3 == header.datatypecode;
+    if (!raw || header.colormaptype || w <= 0 || h <= 0 || (bpp != GRAYSCALE && bpp != RGB && bpp != RGBA) ||
+        file->size() < offset + (size_t)w * h * bpp) {
+        delete file;
+        return false;
+    }
+    width = w;
+    height = h;
+    bytespp = bpp;
+    bool file_top_down = (header.imagedescriptor & 0x20) != 0;
+    if (file_top_down != bottom_up) {
+        mapped = file;
+        data = (unsigned char*)file->writable_data() + offset;
+    }
+    else {
+        // flipping inside the mapping would fault in a private copy of every page;
+        // copying the rows out in reverse order is cheaper
+        unsigned long bytes_per_line = width * bytespp;
+        data = new unsigned char[bytes_per_line * height];
+        for (int y = 0; y < height; y++)
+            memcpy(data + (height - 1 - y) * bytes_per_line, file->data() + offset + y * bytes_per_line, bytes_per_line);
+        delete file;
+    }
+    if (header.imagedescriptor & 0x10) flip_horizontally();
+    std::cerr << width << "x" << height << "/" << bytespp * 8 << " mapped\n";
+    return true;
+}
+
+bool TGAImage::load_rle_data(std::ifstream& in, bool flip) {
     unsigned long pixelcount = width * height;
     unsigned long currentpixel = 0;
     unsigned long currentbyte = 0;
     TGAColor colorbuffer;
+    // at the start of every row, point currentbyte at the row it goes to
+    auto next_pixel = [&]() {
+        if (currentpixel % width == 0) {
+            unsigned long row = currentpixel / width;
+            currentbyte = (flip ? height - 1 - row : row) * width * bytespp;
+        }
+    };
     do {
         unsigned char chunkheader = 0;
         chunkheader = in.get();
@@ -115,13 +199,14 @@ bool TGAImage::load_rle_data(std::ifstream& in) {
                     std::cerr << "an error occured while reading the header\n";
                     return false;
                 }
-                for (int t = 0; t < bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel > pixelcount) {
+                if (currentpixel >= pixelcount) {
                     std::cerr << "Too many pixels read\n";
                     return false;
                 }
+                next_pixel();
+                for (int t = 0; t < bytespp; t++)
+                    data[currentbyte++] = colorbuffer.bgra[t];
+                currentpixel++;
             }
         }
         else {
@@ -132,30 +217,65 @@ bool TGAImage::load_rle_data(std::ifstream& in) {
                 return false;
             }
             for (int i = 0; i < chunkheader; i++) {
-                for (int t = 0; t < bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel > pixelcount) {
+                if (currentpixel >= pixelcount) {
                     std::cerr << "Too many pixels read\n";
                     return false;
                 }
+                next_pixel();
+                for (int t = 0; t < bytespp; t++)
+                    data[currentbyte++] = colorbuffer.bgra[t];
+                currentpixel++;
             }
         }
     } while (currentpixel < pixelcount);
     return true;
 }
 
-bool TGAImage::write_tga_file(const char* filename, bool rle) {
-    unsigned char developer_area_ref[4] = { 0, 0, 0, 0 };
-    unsigned char extension_area_ref[4] = { 0, 0, 0, 0 };
-    unsigned char footer[18] = { 'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0' };
-    std::ofstream out;
-    out.open(filename, std::ios::binary);
-    if (!out.is_open()) {
-        std::cerr << "can't open file " << filename << "\n";
-        out.close();
-        return false;
+namespace {
+    const unsigned char tga_developer_area_ref[4] = { 0, 0, 0, 0 };
+    const unsigned char tga_extension_area_ref[4] = { 0, 0, 0, 0 };
+    const unsigned char tga_footer[18] = { 'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0' };
+
+    inline uint64_t load64(const unsigned char* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
     }
+
+    // index of the lowest nonzero byte of v (v != 0), the words are loaded little-endian
+    inline int first_set_byte(uint64_t v) {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        _BitScanForward64(&bit, v);
+        return (int)(bit >> 3);
+#else
+        return __builtin_ctzll(v) >> 3;
+#endif
+    }
+
+    // nonzero iff some byte of v is zero
+    inline uint64_t has_zero_byte(uint64_t v) {
+        return (v - 0x0101010101010101ull) & ~v & 0x8080808080808080ull;
+    }
+
+    inline uint32_t pixel_key(const unsigned char* p, int bpp) {
+        uint32_t v = 0;
+        memcpy(&v, p, bpp);
+        return v;
+    }
+}
+
+size_t TGAImage::max_encoded_size(bool rle) const {
+    size_t npixels = (size_t)width * height;
+    // a chunk of k pixels takes at most 1 + k*bytespp bytes, so one header byte per pixel
+    // covers every chunking, e.g. grayscale A A B B C A A B B C ... costs 6 bytes per 5 pixels
+    size_t payload = npixels * bytespp + (rle ? npixels : 0);
+    return sizeof(TGA_Header) + payload + sizeof(tga_developer_area_ref) + sizeof(tga_extension_area_ref) + sizeof(tga_footer);
+}
+
+size_t TGAImage::encode_tga(std::vector<unsigned char>& out, bool rle) const {
+    out.resize(max_encoded_size(rle)); // keeps the capacity when the buffer is reused
+    unsigned char* p = out.data();
     TGA_Header header;
     memset((void*)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp << 3;
@@ -163,40 +283,37 @@ bool TGAImage::write_tga_file(const char* filename, bool rle) {
     header.height = height;
     header.datatypecode = (bytespp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
     header.imagedescriptor = 0x20; // top-left origin
-    out.write((char*)&header, sizeof(header));
-    if (!out.good()) {
-        out.close();
-        std::cerr << "can't dump the tga file\n";
-        return false;
-    }
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
     if (!rle) {
-        out.write((char*)data, width * height * bytespp);
-        if (!out.good()) {
-            std::cerr << "can't unload raw data\n";
-            out.close();
-            return false;
-        }
+        size_t nbytes = (size_t)width * height * bytespp;
+        memcpy(p, data, nbytes);
+        p += nbytes;
     }
     else {
-        if (!unload_rle_data(out)) {
-            out.close();
-            std::cerr << "can't unload rle data\n";
-            return false;
-        }
+        p += unload_rle_data(p);
     }
-    out.write((char*)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.write((char*)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
+    memcpy(p, tga_developer_area_ref, sizeof(tga_developer_area_ref));
+    p += sizeof(tga_developer_area_ref);
+    memcpy(p, tga_extension_area_ref, sizeof(tga_extension_area_ref));
+    p += sizeof(tga_extension_area_ref);
+    memcpy(p, tga_footer, sizeof(tga_footer));
+    p += sizeof(tga_footer);
+    size_t size = p - out.data();
+    out.resize(size);
+    return size;
+}
+
+bool TGAImage::write_encoded(const char* filename, const std::vector<unsigned char>& encoded) {
+    std::ofstream out;
+    out.open(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
         out.close();
         return false;
     }
-    out.write((char*)footer, sizeof(footer));
+    // the whole file goes out in one write, large writes bypass the stream buffer
+    out.write((const char*)encoded.data(), encoded.size());
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
         out.close();
@@ -206,47 +323,90 @@ bool TGAImage::write_tga_file(const char* filename, bool rle) {
     return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream& out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width * height;
-    unsigned long curpix = 0;
-    while (curpix < npixels) {
-        unsigned long chunkstart = curpix * bytespp;
-        unsigned long curbyte = curpix * bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix + run_length < npixels && run_length < max_chunk_length) {
-            bool succ_eq = true;
-            for (int t = 0; succ_eq && t < bytespp; t++) {
-                succ_eq = (data[curbyte + t] == data[curbyte + t + bytespp]);
-            }
-            curbyte += bytespp;
-            if (1 == run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
-                break;
+bool TGAImage::write_tga_file(const char* filename, bool rle) {
+    if (!data) {
+        std::cerr << "can't dump an empty image\n";
+        return false;
+    }
+    std::vector<unsigned char> encoded;
+    encode_tga(encoded, rle);
+    return write_encoded(filename, encoded);
+}
+
+// Runs are found by comparing the image with itself shifted by one pixel, eight bytes at
+// a time: pixel i equals pixel i+1 iff bytes [i*bpp, (i+1)*bpp) equal the next bpp bytes.
+// A raw chunk is broken only when a run actually saves space. For bpp >= 3 two equal pixels
+// are cheaper as a run chunk even with the header of the next raw chunk. A grayscale pair is
+// not, unless no raw chunk follows it: it is the end of the image or another run comes next
+size_t TGAImage::unload_rle_data(unsigned char* out) const {
+    const int max_chunk_length = 128;
+    const size_t npixels = (size_t)width * height;
+    const size_t nbytes = npixels * bytespp;
+    unsigned char* start = out;
+
+    // length of the run of pixels equal to pixel i, at most max_chunk_length
+    auto run_length = [&](size_t i) {
+        size_t limit = std::min(npixels - 1, i + max_chunk_length - 1) * bytespp; // compare bytes [i*bpp, limit)
+        size_t b = i * bytespp;
+        while (b + 8 <= limit) {
+            uint64_t diff = load64(data + b) ^ load64(data + b + bytespp);
+            if (diff) return (b + first_set_byte(diff)) / bytespp - i + 1;
+            b += 8;
+        }
+        for (; b < limit; b++)
+            if (data[b] != data[b + bytespp]) break;
+        return b / bytespp - i + 1;
+    };
+
+    auto gray_run_starts = [&](size_t j) {
+        if (j + 1 >= npixels || data[j] != data[j + 1]) return false;
+        return j + 2 >= npixels || data[j] == data[j + 2] || (j + 3 < npixels && data[j + 2] == data[j + 3]);
+    };
+
+    // first pixel j in [i, end) where a run chunk should start, or end.
+    // The last pixel of a full raw chunk is not checked, same as the old encoder did
+    auto next_run = [&](size_t i, size_t end) {
+        if (bytespp == GRAYSCALE) {
+            // byte k of m is set when data[j+k] == data[j+k+1] and the next byte (or pair) is equal too
+            size_t j = i;
+            while (j + 11 <= nbytes && j + 8 <= end) {
+                uint64_t x0 = load64(data + j), x1 = load64(data + j + 1), x2 = load64(data + j + 2), x3 = load64(data + j + 3);
+                uint64_t m = has_zero_byte((x0 ^ x1) | (x0 ^ x2)) | has_zero_byte((x0 ^ x1) | (x2 ^ x3));
+                if (m) return j + first_set_byte(m);
+                j += 8;
             }
-            run_length++;
+            for (; j < end; j++)
+                if (gray_run_starts(j)) return j;
+            return end;
         }
-        curpix += run_length;
-        out.put(raw ? run_length - 1 : run_length + 127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        size_t j = i;
+        uint32_t cur = pixel_key(data + j * bytespp, bytespp);
+        for (; j + 1 < npixels && j + 1 < end; j++) {
+            uint32_t next = pixel_key(data + (j + 1) * bytespp, bytespp);
+            if (cur == next) return j;
+            cur = next;
         }
-        out.write((char*)(data + chunkstart), (raw ? run_length * bytespp : bytespp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        return end;
+    };
+
+    size_t curpix = 0;
+    while (curpix < npixels) {
+        size_t run = run_length(curpix);
+        if (run >= 3 || (run == 2 && (bytespp != GRAYSCALE || gray_run_starts(curpix)))) {
+            *out++ = (unsigned char)(run + 127);
+            memcpy(out, data + curpix * bytespp, bytespp);
+            out += bytespp;
+            curpix += run;
+            continue;
         }
+        size_t end = std::min(npixels, curpix + max_chunk_length);
+        size_t raw = next_run(curpix, end) - curpix;
+        *out++ = (unsigned char)(raw - 1);
+        memcpy(out, data + curpix * bytespp, raw * bytespp);
+        out += raw * bytespp;
+        curpix += raw;
     }
-    return true;
+    return out - start;
 }
 
 TGAColor TGAImage::get(int x, int y) {
@@ -352,7 +512,7 @@ bool TGAImage::scale(int w, int h) {
             nscanline += nlinebytes;
         }
     }
-    delete[] data;
+    release();
     data = tdata;
     width = w;
     height = h;
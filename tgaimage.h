@@ -2,6 +2,7 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <vector>
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -63,15 +64,20 @@ struct TGAColor {
 };
 
 
+class MappedFile;
+
 class TGAImage {
 protected:
     unsigned char* data;
     int width;
     int height;
     int bytespp;
+    MappedFile* mapped; // set when data points into a file mapping (see map_tga_file)
+
+    void release();
 
-    bool   load_rle_data(std::ifstream& in);
-    bool unload_rle_data(std::ofstream& out);
+    bool   load_rle_data(std::ifstream& in, bool flip);
+    size_t unload_rle_data(unsigned char* out) const; // returns the number of bytes written
 public:
     enum Format {
         GRAYSCALE = 1, RGB = 3, RGBA = 4
@@ -80,8 +86,24 @@ public:
     TGAImage();
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage& img);
-    bool read_tga_file(const char* filename);
+    TGAImage(TGAImage&& img);
+    // Rows end up top-down (row 0 is the top of the picture), or bottom-up when
+    // bottom_up is set. The row order is chosen while decoding, without a second flip pass
+    bool read_tga_file(const char* filename, bool bottom_up = false);
+    // Uncompressed files only. If the stored row order already matches, the pixels are used
+    // in place from a copy-on-write mapping of the file: nothing is copied up front and
+    // writes copy only the touched pages. Otherwise the rows are copied out of the mapping
+    // in reverse order. Returns false for RLE files or on error, the caller can fall back
+    // to read_tga_file()
+    bool map_tga_file(const char* filename, bool bottom_up = false);
+    bool is_mapped() const { return mapped != NULL; }
     bool write_tga_file(const char* filename, bool rle = true);
+    // The whole file (header, pixels, footer) encoded in memory. out is resized to the
+    // encoded size, its capacity is kept, so a buffer reused across frames is allocated once
+    size_t encode_tga(std::vector<unsigned char>& out, bool rle = true) const;
+    size_t max_encoded_size(bool rle = true) const;
+    // writes an encode_tga() result with a single write call
+    static bool write_encoded(const char* filename, const std::vector<unsigned char>& encoded);
     bool flip_horizontally();
     bool flip_vertically();
     bool scale(int w, int h);
@@ -90,10 +112,13 @@ public:
     bool set(int x, int y, const TGAColor& c);
     ~TGAImage();
     TGAImage& operator =(const TGAImage& img);
+    TGAImage& operator =(TGAImage&& img);
     int get_width();
     int get_height();
     int get_bytespp();
     unsigned char* buffer();
+    // unchecked access to row y (0 <= y < height), used by the rasterizer
+    unsigned char* scanline(int y) { return data + (size_t)y * width * bytespp; }
     void clear();
 };
 
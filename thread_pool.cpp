@@ -0,0 +1,64 @@
+#include "thread_pool.h"
+
+int ThreadPool::hardware_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? (int)n : 1;
+}
+
+ThreadPool::ThreadPool(int nthreads) : job(nullptr), njobs(0), next_job(0), busy(0), generation(0), stop(false) {
+    if (nthreads <= 0) nthreads = hardware_threads();
+    for (int i = 1; i < nthreads; i++)
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv_start.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+void ThreadPool::run_jobs(int worker) {
+    for (int i = next_job++; i < njobs; i = next_job++)
+        (*job)(worker, i);
+}
+
+void ThreadPool::worker_loop(int worker) {
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_start.wait(lock, [&] { return stop || generation != seen; });
+            if (stop) return;
+            seen = generation;
+        }
+        run_jobs(worker);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--busy == 0) cv_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int, int)>& fn) {
+    if (n <= 0) return;
+    if (workers.empty() || n == 1) {
+        for (int i = 0; i < n; i++) fn(0, i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        job = &fn;
+        njobs = n;
+        next_job = 0;
+        busy = (int)workers.size();
+        generation++;
+    }
+    cv_start.notify_all();
+    run_jobs(0);
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_done.wait(lock, [&] { return busy == 0; });
+    job = nullptr;
+}
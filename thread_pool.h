@@ -0,0 +1,43 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+//   :      ,
+//    N    N-1 .
+class ThreadPool {
+public:
+    explicit ThreadPool(int nthreads = 0); // 0 -   
+    ~ThreadPool();
+
+    int size() const { return (int)workers.size() + 1; }
+
+    //  job(worker, i)   i  [0, n)   .
+    // worker -    [0, size()),     
+    void parallel_for(int n, const std::function<void(int, int)>& job);
+
+    static int hardware_threads();
+
+private:
+    void worker_loop(int worker);
+    void run_jobs(int worker);
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+
+    const std::function<void(int, int)>* job;
+    int njobs;
+    std::atomic<int> next_job;
+    int busy;
+    unsigned generation;
+    bool stop;
+};
+
+#endif //__THREAD_POOL_H__
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <limits>
+#include "tile_renderer.h"
+
+TileRenderer::TileRenderer(int width, int height, int tile_size, int nthreads)
+    : width(width), height(height), tile_size(tile_size), own_pool(new ThreadPool(nthreads)), pool(own_pool.get()) {
+    init_tiles();
+}
+
+TileRenderer::TileRenderer(int width, int height, int tile_size, ThreadPool& shared_pool)
+    : width(width), height(height), tile_size(tile_size), pool(&shared_pool) {
+    init_tiles();
+}
+
+void TileRenderer::init_tiles() {
+    if (tile_size <= 0) tile_size = 64;
+    //     (8x8),      
+    tile_size = (tile_size + 7) / 8 * 8;
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+    bins.resize(tiles_x * tiles_y);
+}
+
+void TileRenderer::clear() {
+    tris.clear();
+    for (size_t i = 0; i < bins.size(); i++) bins[i].clear();
+}
+
+bool TileRenderer::tile_range(Vec4f* pts, int& tx0, int& ty0, int& tx1, int& ty1) const {
+    // Bounding box    ; triangle()    
+    ClippedPolygon poly;
+    if (clip_triangle(pts, width, height, poly) == CLIP_REJECTED) return false;
+    Vec2f bboxmin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    for (int i = 0; i < poly.n; i++) {
+        for (int j = 0; j < 2; j++) {
+            bboxmin[j] = std::min(bboxmin[j], poly.pts[i][j] / poly.pts[i][3]);
+            bboxmax[j] = std::max(bboxmax[j], poly.pts[i][j] / poly.pts[i][3]);
+        }
+    }
+    tx0 = (int)std::max(0.f, std::min((float)width - 1, bboxmin.x)) / tile_size;
+    ty0 = (int)std::max(0.f, std::min((float)height - 1, bboxmin.y)) / tile_size;
+    tx1 = (int)std::max(0.f, std::min((float)width - 1, bboxmax.x)) / tile_size;
+    ty1 = (int)std::max(0.f, std::min((float)height - 1, bboxmax.y)) / tile_size;
+    return true;
+}
+
+void TileRenderer::bin(int iface, Vec4f* pts) {
+    int tx0, ty0, tx1, ty1;
+    if (!tile_range(pts, tx0, ty0, tx1, ty1)) return;
+
+    BinnedTriangle t;
+    t.iface = iface;
+    for (int i = 0; i < 3; i++) t.pts[i] = pts[i];
+    int idx = (int)tris.size();
+    tris.push_back(t);
+
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++)
+            bins[tx + ty * tiles_x].push_back(idx);
+}
+
+//    :       ,   bin()
+void TileRenderer::merge_chunks(int nchunks) {
+    for (int c = 0; c < nchunks; c++) {
+        const BinChunk& chunk = chunks[c];
+        int base = (int)tris.size();
+        tris.insert(tris.end(), chunk.tris.begin(), chunk.tris.end());
+        for (size_t k = 0; k < chunk.refs.size(); k++) bins[chunk.refs[k].first].push_back(base + chunk.refs[k].second);
+    }
+}
+
+void TileRenderer::tile_rect(int tile, Vec2i& clipmin, Vec2i& clipmax) const {
+    int tx = tile % tiles_x;
+    int ty = tile / tiles_x;
+    clipmin = Vec2i(tx * tile_size, ty * tile_size);
+    clipmax = Vec2i(std::min(width, clipmin.x + tile_size) - 1, std::min(height, clipmin.y + tile_size) - 1);
+}
+
+void TileRenderer::flush_depth(DepthBuffer& zbuffer) {
+    pool->parallel_for(ntiles(), [&](int, int tile) {
+        const std::vector<int>& bin = bins[tile];
+        Vec2i clipmin, clipmax;
+        tile_rect(tile, clipmin, clipmax);
+        for (size_t k = 0; k < bin.size(); k++) depth_triangle(tris[bin[k]].pts, zbuffer, clipmin, clipmax);
+    });
+    zbuffer.hiz_build();
+}
+
+void TileRenderer::flush(IShader& shader, TGAImage& image, DepthBuffer& zbuffer, const VertexCache* cache) {
+    flush<IShader>(shader, image, zbuffer, cache);
+}
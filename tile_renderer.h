@@ -0,0 +1,145 @@
+#ifndef __TILE_RENDERER_H__
+#define __TILE_RENDERER_H__
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include "tgaimage.h"
+#include "geometry.h"
+#include "our_gl.h"
+#include "depth_buffer.h"
+#include "thread_pool.h"
+#include "vertex_cache.h"
+#include "rasterizer.h"
+#include "gbuffer.h"
+
+//   :
+// 1) bin()        ;
+// 2) flush()   ,     
+//        ,     .
+class TileRenderer {
+public:
+    TileRenderer(int width, int height, int tile_size = 64, int nthreads = 0);
+    //  ,  :     ( ) 
+    //   . flush()  TileRenderer       
+    TileRenderer(int width, int height, int tile_size, ThreadPool& shared_pool);
+
+    void clear();                   //     
+    void bin(int iface, Vec4f* pts); // pts -  shader.vertex()   
+    //   [0, nfaces)  pool  . fetch(worker, iface, pts)
+    //  pts    false,   ;   
+    //  .      ,     ,
+    //   bin()  .   ,   fetch  true
+    template <class Fetch> int bin_parallel(int nfaces, ThreadPool& pool, Fetch fetch);
+    // cache -     VertexCache, varying-   ,
+    //  vertex()  
+    void flush(IShader& shader, TGAImage& image, DepthBuffer& zbuffer, const VertexCache* cache = nullptr);
+    //    triangle<Shader>():      
+    template <class Shader> void flush(Shader& shader, TGAImage& image, DepthBuffer& zbuffer, const VertexCache* cache = nullptr);
+    //  :  ,   (. rasterizer.h).
+    //  Z,  ,   
+    void flush_depth(DepthBuffer& zbuffer);
+    //    :   G-  
+    template <class Shader> void flush_gbuffer(Shader& shader, GBuffer& gbuffer, const VertexCache* cache = nullptr);
+
+    int ntiles() const { return tiles_x * tiles_y; }
+    int nthreads() const { return pool->size(); }
+    ThreadPool& thread_pool() { return *pool; } //    
+
+private:
+    struct BinnedTriangle {
+        int iface;
+        Vec4f pts[3];
+    };
+
+    int width, height;
+    int tile_size;
+    int tiles_x, tiles_y;
+
+    //   bin_parallel():     (,   tris )
+    struct BinChunk {
+        std::vector<BinnedTriangle> tris;
+        std::vector<std::pair<int, int> > refs;
+        int faces;
+    };
+
+    std::vector<BinnedTriangle> tris;
+    std::vector<std::vector<int> > bins; //   tris   
+    std::vector<BinChunk> chunks;        //     
+    std::unique_ptr<ThreadPool> own_pool;
+    ThreadPool* pool;
+
+    void init_tiles();
+    // ,     ; false -  
+    bool tile_range(Vec4f* pts, int& tx0, int& ty0, int& tx1, int& ty1) const;
+    void merge_chunks(int nchunks);
+
+    // draw(shader, triangle, clipmin, clipmax)    
+    template <class Shader, class Draw> void for_each_tile(Shader& shader, const VertexCache* cache, Draw draw);
+    void tile_rect(int tile, Vec2i& clipmin, Vec2i& clipmax) const;
+};
+
+template <class Fetch> int TileRenderer::bin_parallel(int nfaces, ThreadPool& pool, Fetch fetch) {
+    const int CHUNK = 4096; //    
+    int nchunks = (nfaces + CHUNK - 1) / CHUNK;
+    if ((int)chunks.size() < nchunks) chunks.resize(nchunks);
+    pool.parallel_for(nchunks, [&](int worker, int c) {
+        BinChunk& chunk = chunks[c];
+        chunk.tris.clear();
+        chunk.refs.clear();
+        chunk.faces = 0;
+        int end = std::min(nfaces, (c + 1) * CHUNK);
+        for (int iface = c * CHUNK; iface < end; iface++) {
+            BinnedTriangle t;
+            if (!fetch(worker, iface, t.pts)) continue;
+            chunk.faces++;
+            int tx0, ty0, tx1, ty1;
+            if (!tile_range(t.pts, tx0, ty0, tx1, ty1)) continue;
+            t.iface = iface;
+            int idx = (int)chunk.tris.size();
+            chunk.tris.push_back(t);
+            for (int ty = ty0; ty <= ty1; ty++)
+                for (int tx = tx0; tx <= tx1; tx++) chunk.refs.push_back(std::make_pair(tx + ty * tiles_x, idx));
+        }
+    });
+    merge_chunks(nchunks);
+    int faces = 0;
+    for (int c = 0; c < nchunks; c++) faces += chunks[c].faces;
+    return faces;
+}
+
+template <class Shader> void TileRenderer::flush(Shader& shader, TGAImage& image, DepthBuffer& zbuffer, const VertexCache* cache) {
+    for_each_tile(shader, cache, [&](Shader& local, BinnedTriangle& t, Vec2i clipmin, Vec2i clipmax) {
+        triangle<Shader>(t.pts, local, image, zbuffer, clipmin, clipmax);
+    });
+}
+
+template <class Shader> void TileRenderer::flush_gbuffer(Shader& shader, GBuffer& gbuffer, const VertexCache* cache) {
+    for_each_tile(shader, cache, [&](Shader& local, BinnedTriangle& t, Vec2i clipmin, Vec2i clipmax) {
+        gbuffer_triangle(t.pts, local, gbuffer, clipmin, clipmax);
+    });
+}
+
+template <class Shader, class Draw> void TileRenderer::for_each_tile(Shader& shader, const VertexCache* cache, Draw draw) {
+    //      : varying-   vertex()
+    std::vector<std::unique_ptr<IShader> > shaders(pool->size());
+    for (size_t i = 0; i < shaders.size(); i++) shaders[i].reset(shader.clone());
+
+    pool->parallel_for(ntiles(), [&](int worker, int tile) {
+        const std::vector<int>& bin = bins[tile];
+        if (bin.empty()) return;
+        Shader& local = static_cast<Shader&>(*shaders[worker]); // clone()     
+        Vec2i clipmin, clipmax;
+        tile_rect(tile, clipmin, clipmax);
+        for (size_t k = 0; k < bin.size(); k++) {
+            BinnedTriangle& t = tris[bin[k]];
+            //  varying- 
+            if (cache) cache->restore_face(local, t.iface);
+            else for (int j = 0; j < 3; j++) local.vertex(t.iface, j);
+            draw(local, t, clipmin, clipmax);
+        }
+    });
+}
+
+#endif //__TILE_RENDERER_H__
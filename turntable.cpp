@@ -0,0 +1,341 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include "turntable.h"
+#include "model.h"
+#include "our_gl.h"
+#include "rasterizer.h"
+#include "depth_buffer.h"
+#include "vertex_cache.h"
+#include "thread_pool.h"
+#include "tile_renderer.h"
+#include "bounded_queue.h"
+#include "mesh_clusters.h"
+
+namespace {
+
+//   main():      ,  
+const unsigned turntable_features = 0;
+typedef PhongShaderT<turntable_features> TurntableShader;
+
+struct FrameView {
+    Camera camera;
+    std::string filename;
+};
+
+struct FrameStats {
+    double geometry_ms; // ,  (     )
+    double raster_ms;   //   
+    double write_ms;    // , , 
+    double latency_ms;  //      
+    int faces;
+    int clusters_culled;
+    bool written;
+};
+
+// ,       :   ( )
+//     
+struct FrameWorker {
+    TGAImage image;
+    DepthBuffer zbuffer;
+    TurntableShader shader;
+    VertexCache* vcache;
+    TileRenderer* tiles;                //   :      
+    std::vector<unsigned char> encoded; //   TGA
+    std::vector<unsigned char> visible; //    ( opt.clusters)
+    bool batched;                       //     transform_all()
+    int frame;                          // ,    
+    std::chrono::steady_clock::time_point started;
+
+    RenderContext context;
+    DrawCall call;
+
+    FrameWorker(int width, int height, const Model& model) : image(width, height, TGAImage::RGB), zbuffer(width, height),
+        vcache(nullptr), tiles(nullptr), batched(false), frame(-1), context(width, height, &image, &zbuffer), call(context, model) {}
+    ~FrameWorker() {
+        delete vcache;
+        delete tiles;
+    }
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1) {
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+//    uniform- ,  ,   -    pool.
+//         :   - 
+// .    
+int setup_frame(FrameWorker& fw, const TurntableOptions& opt, const Camera& cam, const Matrix& projection,
+    const Vec3f& light_dir, ThreadPool& pool) {
+    const Model& model = *fw.call.model;
+    Camera camera = cam;
+    fw.call.model_view = camera.get_view_matrix();
+    fw.call.projection = projection;
+    TurntableShader& shader = fw.shader;
+    shader.setup_scene(fw.call, cam.eye, cam.center, light_dir);
+    shader.specular_mode = opt.specular_mode;
+    shader.prepare();
+
+    MeshClusters::CullStats cs = { 0, 0, 0, model.nfaces() };
+    if (opt.clusters) cs = opt.clusters->cull(fw.call.viewport() * fw.call.mvp(), fw.context.width, fw.context.height, fw.visible);
+    fw.batched = false;
+    if (opt.vcache) {
+        if (!fw.vcache) fw.vcache = new VertexCache(model, shader);
+        fw.vcache->clear();
+        //   main():     ,    
+        fw.batched = pool.size() > 1 || 2 * cs.faces > model.nfaces();
+        if (fw.batched) fw.vcache->transform_all(shader, pool);
+    }
+    return cs.culled;
+}
+
+bool face_visible(const FrameWorker& fw, const TurntableOptions& opt, int iface) {
+    return !opt.clusters || fw.visible[iface];
+}
+
+void fetch_face(FrameWorker& fw, int iface, Vec4f* clip_coords) {
+    if (fw.vcache) fw.vcache->fetch_face(fw.shader, iface, clip_coords);
+    else for (int j = 0; j < 3; j++) clip_coords[j] = fw.shader.vertex(iface, j);
+}
+
+//        
+bool write_frame(FrameWorker& fw, const std::string& filename) {
+    fw.image.flip_vertically();
+    fw.image.encode_tga(fw.encoded);
+    return TGAImage::write_encoded(filename.c_str(), fw.encoded);
+}
+
+bool read_camera_path(const char* filename, const Camera& base, const std::string& prefix, std::vector<FrameView>& views) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "can't open camera path " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream ss(line);
+        float yaw, pitch, radius = -1.f;
+        if (!(ss >> yaw)) continue; //    
+        if (!(ss >> pitch)) {
+            std::cerr << "bad camera path line: " << line << std::endl;
+            return false;
+        }
+        ss >> radius;
+        FrameView view = { base, prefix + std::to_string(views.size()) + ".tga" };
+        view.camera.orbit(yaw, pitch, radius);
+        views.push_back(view);
+    }
+    return true;
+}
+
+//   ,     ;   -  
+void render_parallel(const TurntableOptions& opt, const Model& model, const std::vector<FrameView>& views,
+    const Matrix& projection, const Vec3f& light_dir, int width, int height, std::vector<FrameStats>& stats) {
+    ThreadPool pool(opt.nthreads);
+    std::vector<FrameWorker*> workers(pool.size(), nullptr);
+    std::cout << "Turntable: " << views.size() << " frames " << width << "x" << height << ", "
+        << std::min(pool.size(), (int)views.size()) << " frames in parallel" << std::endl;
+
+    pool.parallel_for((int)views.size(), [&](int w, int f) {
+        if (!workers[w]) {
+            workers[w] = new FrameWorker(width, height, model);
+            workers[w]->zbuffer.enable_hiz(opt.hiz);
+        }
+        FrameWorker& fw = *workers[w];
+        ThreadPool serial(1); //   :  ,   
+        auto r0 = std::chrono::steady_clock::now();
+        int clusters_culled = setup_frame(fw, opt, views[f].camera, projection, light_dir, serial);
+        auto r1 = std::chrono::steady_clock::now();
+
+        fw.image.clear();
+        fw.zbuffer.clear();
+        int faces = 0;
+        for (int i = 0; i < model.nfaces(); i++) {
+            if (!face_visible(fw, opt, i)) continue;
+            Vec4f clip_coords[3];
+            fetch_face(fw, i, clip_coords);
+            if (cull_triangle(clip_coords, width, height, opt.cull_mode) != CULL_KEEP) continue;
+            triangle<TurntableShader>(clip_coords, fw.shader, fw.context);
+            faces++;
+        }
+        auto r2 = std::chrono::steady_clock::now();
+
+        //  ,      
+        bool ok = write_frame(fw, views[f].filename);
+        auto r3 = std::chrono::steady_clock::now();
+
+        FrameStats& s = stats[f];
+        s.geometry_ms = elapsed_ms(r0, r1);
+        s.raster_ms = elapsed_ms(r1, r2);
+        s.write_ms = elapsed_ms(r2, r3);
+        s.latency_ms = elapsed_ms(r0, r3);
+        s.faces = faces;
+        s.clusters_culled = clusters_culled;
+        s.written = ok;
+    });
+    for (size_t w = 0; w < workers.size(); w++) delete workers[w];
+}
+
+//      .        
+//  -   pool,  (  ) - .
+//   ,  
+int bin_frame(FrameWorker& fw, const TurntableOptions& opt, ThreadPool& pool) {
+    int nfaces = fw.call.model->nfaces();
+    int width = fw.context.width, height = fw.context.height;
+    if (fw.vcache && !fw.batched) {
+        int faces = 0;
+        for (int i = 0; i < nfaces; i++) {
+            if (!face_visible(fw, opt, i)) continue;
+            Vec4f clip_coords[3];
+            fetch_face(fw, i, clip_coords);
+            if (cull_triangle(clip_coords, width, height, opt.cull_mode) != CULL_KEEP) continue;
+            fw.tiles->bin(i, clip_coords);
+            faces++;
+        }
+        return faces;
+    }
+    // vertex()  varying-:        
+    std::vector<std::unique_ptr<IShader> > shaders(fw.vcache ? 0 : pool.size());
+    for (size_t i = 0; i < shaders.size(); i++) shaders[i].reset(fw.shader.clone());
+    return fw.tiles->bin_parallel(nfaces, pool, [&](int worker, int iface, Vec4f* clip_coords) {
+        if (!face_visible(fw, opt, iface)) return false;
+        if (fw.vcache) fw.vcache->face_pts(iface, clip_coords);
+        else {
+            TurntableShader& local = static_cast<TurntableShader&>(*shaders[worker]); // clone()     
+            for (int j = 0; j < 3; j++) clip_coords[j] = local.vertex(iface, j);
+        }
+        return cull_triangle(clip_coords, width, height, opt.cull_mode) == CULL_KEEP;
+    });
+}
+
+//  :   (, , ,   ),
+//  (   )        
+//     .  opt.pipeline:  
+//   ,     .   N ,
+//   N+1,    N-1
+void render_pipelined(const TurntableOptions& opt, const Model& model, const std::vector<FrameView>& views,
+    const Matrix& projection, const Vec3f& light_dir, int width, int height, std::vector<FrameStats>& stats) {
+    // :  - ,  (, ,   ) - ,
+    //  - 
+    int nthreads = opt.nthreads > 0 ? opt.nthreads : ThreadPool::hardware_threads();
+    int geometry_threads = std::max(1, nthreads / 4);
+    ThreadPool geometry_pool(geometry_threads);
+    ThreadPool raster_pool(std::max(1, nthreads - geometry_threads - 1));
+    int nslots = std::max(2, opt.pipeline);
+    std::cout << "Turntable: " << views.size() << " frames " << width << "x" << height << ", pipeline of "
+        << nslots << " frames, threads: geometry " << geometry_pool.size() << ", raster " << raster_pool.size()
+        << ", write 1" << std::endl;
+
+    std::vector<FrameWorker*> slots(nslots);
+    BoundedQueue<FrameWorker*> free_slots(nslots), binned(nslots), shaded(nslots);
+    for (int k = 0; k < nslots; k++) {
+        slots[k] = new FrameWorker(width, height, model);
+        slots[k]->zbuffer.enable_hiz(opt.hiz);
+        slots[k]->tiles = new TileRenderer(width, height, opt.tile_size, raster_pool);
+        free_slots.push(slots[k]);
+    }
+
+    std::thread geometry([&]() {
+        for (int f = 0; f < (int)views.size(); f++) {
+            FrameWorker* fw;
+            free_slots.pop(fw); // ,     
+            fw->frame = f;
+            fw->started = std::chrono::steady_clock::now();
+            stats[f].clusters_culled = setup_frame(*fw, opt, views[f].camera, projection, light_dir, geometry_pool);
+            fw->tiles->clear();
+            stats[f].faces = bin_frame(*fw, opt, geometry_pool);
+            stats[f].geometry_ms = elapsed_ms(fw->started, std::chrono::steady_clock::now());
+            binned.push(fw);
+        }
+        binned.close();
+    });
+
+    std::thread writer([&]() {
+        FrameWorker* fw;
+        while (shaded.pop(fw)) {
+            auto w0 = std::chrono::steady_clock::now();
+            FrameStats& s = stats[fw->frame];
+            s.written = write_frame(*fw, views[fw->frame].filename);
+            auto w1 = std::chrono::steady_clock::now();
+            s.write_ms = elapsed_ms(w0, w1);
+            s.latency_ms = elapsed_ms(fw->started, w1);
+            free_slots.push(fw);
+        }
+    });
+
+    //  -   , ,   raster_pool
+    FrameWorker* fw;
+    while (binned.pop(fw)) {
+        auto r0 = std::chrono::steady_clock::now();
+        fw->image.clear();
+        fw->zbuffer.clear();
+        fw->tiles->flush<TurntableShader>(fw->shader, fw->image, fw->zbuffer, fw->vcache);
+        stats[fw->frame].raster_ms = elapsed_ms(r0, std::chrono::steady_clock::now());
+        shaded.push(fw);
+    }
+    shaded.close();
+    geometry.join();
+    writer.join();
+    for (int k = 0; k < nslots; k++) delete slots[k];
+}
+
+} // namespace
+
+int run_turntable(const TurntableOptions& opt, const Model& model, const Camera& base, const Matrix& projection,
+    const Vec3f& light_dir, int width, int height) {
+    std::string prefix = opt.prefix ? opt.prefix : "output_angle";
+    std::vector<FrameView> views;
+    if (opt.path) {
+        if (!read_camera_path(opt.path, base, prefix, views)) return 1;
+    }
+    else {
+        for (int k = 0; k < opt.frames; k++) {
+            float angle = 360.f * k / opt.frames;
+            FrameView view = { base, prefix + std::to_string((int)std::lround(angle)) + ".tga" };
+            view.camera.orbit_y(angle);
+            views.push_back(view);
+        }
+    }
+    if (views.empty()) {
+        std::cerr << "no camera views to render" << std::endl;
+        return 1;
+    }
+
+    std::vector<FrameStats> stats(views.size());
+    auto t0 = std::chrono::steady_clock::now();
+    if (opt.pipeline > 0) render_pipelined(opt, model, views, projection, light_dir, width, height, stats);
+    else render_parallel(opt, model, views, projection, light_dir, width, height, stats);
+    auto t1 = std::chrono::steady_clock::now();
+
+    double geometry_total = 0, raster_total = 0, write_total = 0, latency_total = 0;
+    int failed = 0;
+    for (size_t f = 0; f < views.size(); f++) {
+        const FrameStats& s = stats[f];
+        std::cout << "  " << views[f].filename << ": " << s.faces << " faces";
+        if (opt.clusters) std::cout << ", " << s.clusters_culled << " clusters culled";
+        std::cout << ", geometry " << s.geometry_ms
+            << " ms, raster " << s.raster_ms << " ms, write " << s.write_ms << " ms, latency " << s.latency_ms
+            << " ms" << (s.written ? "" : " FAILED") << std::endl;
+        geometry_total += s.geometry_ms;
+        raster_total += s.raster_ms;
+        write_total += s.write_ms;
+        latency_total += s.latency_ms;
+        if (!s.written) failed++;
+    }
+    size_t n = views.size();
+    double wall = elapsed_ms(t0, t1);
+    std::cout << "Turntable total: " << wall << " ms, " << n * 1000. / wall << " frames/s, "
+        << (double)n * width * height / (wall * 1000.) << " Mpixel/s; per frame geometry " << geometry_total / n
+        << " ms, raster " << raster_total / n << " ms, write " << write_total / n << " ms, latency "
+        << latency_total / n << " ms" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __TURNTABLE_H__
+#define __TURNTABLE_H__
+
+#include "geometry.h"
+#include "camera.h"
+#include "phong_shader.h"
+
+class MeshClusters;
+
+//       :    ,
+//     , z-,      
+//       ( ).   
+// ,    ;   -   main().
+//  pipeline   :   , 
+//     - ,     .
+struct TurntableOptions {
+    int frames;          // N     Camera::orbit_y(), 0 -   path
+    const char* path;    //   :  "yaw pitch [radius]"    Camera::orbit()
+    const char* prefix;  //  : prefix +  ( )    ( ) + ".tga"
+    int nthreads;        // 0 -   
+    int pipeline;        // 0 -  ,        (  2)
+    int tile_size;       //    
+    int cull_mode;
+    bool vcache;
+    bool hiz;
+    SpecularMode specular_mode;
+    const MeshClusters* clusters; //      , nullptr -  
+};
+
+//    prefix*.tga,         .
+// base -   , projection -    .  
+//    RenderContext  DrawCall.     main()
+int run_turntable(const TurntableOptions& opt, const Model& model, const Camera& base, const Matrix& projection,
+    const Vec3f& light_dir, int width, int height);
+
+#endif //__TURNTABLE_H__
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include "vertex_cache.h"
+
+VertexCache::VertexCache(const Model& model, const IShader& shader)
+    : model(model), stride(shader.varying_size()), pts(model.nverts()), varyings((size_t)model.nverts() * stride),
+      stamp(model.nverts(), 0), frame(1), nlookups(0), nhits(0), ntransformed(0) {
+}
+
+void VertexCache::clear() {
+    if (++frame == 0) { //  :      
+        std::fill(stamp.begin(), stamp.end(), 0);
+        frame = 1;
+    }
+    nlookups = nhits = ntransformed = 0;
+}
+
+void VertexCache::transform_all(IShader& shader, ThreadPool& pool) {
+    const int CHUNK = 4096; //    
+    int n = model.nverts();
+    pool.parallel_for((n + CHUNK - 1) / CHUNK, [&](int, int chunk) {
+        int begin = chunk * CHUNK;
+        int end = std::min(n, begin + CHUNK);
+        shader.vertex_batch(begin, end, &pts[begin], &varyings[(size_t)begin * stride]);
+        std::fill(stamp.begin() + begin, stamp.begin() + end, frame);
+    });
+    ntransformed += n;
+}
+
+void VertexCache::fetch_face(IShader& shader, int iface, Vec4f* out) {
+    ConstSpan<int> face = model.face(iface);
+    for (int j = 0; j < 3; j++) {
+        int v = face[j];
+        float* vary = &varyings[(size_t)v * stride];
+        nlookups++;
+        if (stamp[v] == frame) {
+            nhits++;
+        } else {
+            pts[v] = shader.vertex_indexed(v, vary);
+            stamp[v] = frame;
+            ntransformed++;
+        }
+        shader.set_varyings(j, vary);
+        out[j] = pts[v];
+    }
+}
+
+void VertexCache::face_pts(int iface, Vec4f* out) const {
+    ConstSpan<int> face = model.face(iface);
+    for (int j = 0; j < 3; j++) out[j] = pts[face[j]];
+}
+
+void VertexCache::restore_face(IShader& shader, int iface) const {
+    ConstSpan<int> face = model.face(iface);
+    for (int j = 0; j < 3; j++) shader.set_varyings(j, &varyings[(size_t)face[j] * stride]);
+}
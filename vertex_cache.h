@@ -0,0 +1,48 @@
+#ifndef __VERTEX_CACHE_H__
+#define __VERTEX_CACHE_H__
+
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+#include "our_gl.h"
+#include "thread_pool.h"
+
+//      .
+//      ~6 ; vertex_indexed()  
+//      ,     .
+//      (varying_size() > 0).
+class VertexCache {
+public:
+    VertexCache(const Model& model, const IShader& shader);
+
+    void clear(); //  :   uniform-  
+
+    //       shader.vertex_batch(),
+    //   -   pool.   fetch_face()   
+    void transform_all(IShader& shader, ThreadPool& pool);
+
+    // pts -     ,     vertex();
+    // varying-        
+    void fetch_face(IShader& shader, int iface, Vec4f* pts);
+    //     transform_all():  varying-  ,
+    //       
+    void face_pts(int iface, Vec4f* pts) const;
+    //   varying-    (    )
+    void restore_face(IShader& shader, int iface) const;
+
+    long long lookups() const { return nlookups; }
+    long long hits() const { return nhits; }
+    long long transformed() const { return ntransformed; } //   
+    double hit_rate() const { return nlookups ? (double)nhits / nlookups : 0.; }
+
+private:
+    const Model& model;
+    int stride; // float- varying-  
+    std::vector<Vec4f> pts;
+    std::vector<float> varyings;
+    std::vector<unsigned> stamp; //  ,    
+    unsigned frame;
+    long long nlookups, nhits, ntransformed;
+};
+
+#endif //__VERTEX_CACHE_H__
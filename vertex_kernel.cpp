@@ -0,0 +1,177 @@
+#include <string>
+#include "vertex_kernel.h"
+#include "simd.h"
+
+typedef void (*VertexKernel)(const VertexTransform& xf, const Vec3f* positions, const Vec3f* normals, int n,
+                             Vec4f* screen, Vec3f* ndc, Vec3f* nrm);
+
+// ======================
+//   -   ,   PhongShader::vertex_indexed()
+// ======================
+static void transform_scalar(const VertexTransform& xf, const Vec3f* positions, const Vec3f* normals, int n,
+                             Vec4f* screen, Vec3f* ndc, Vec3f* nrm) {
+    for (int i = 0; i < n; i++) {
+        Vec4f clip = xf.mvp * embed<4>(positions[i], 1.f);
+        screen[i] = xf.viewport * clip;
+        ndc[i] = proj<3>(clip / clip[3]);
+        nrm[i] = proj<3>(xf.normal * embed<4>(normals[i], 0.f));
+    }
+}
+
+#ifdef KG3_X86
+
+//     (x, y, z, w)   operator*  vec:
+// ((((0 + m3*w) + m2*z) + m1*y) + m0*x)
+#define ROW_SSE(m, x, y, z, w) _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(zero, _mm_mul_ps(m[3], w)), \
+    _mm_mul_ps(m[2], z)), _mm_mul_ps(m[1], y)), _mm_mul_ps(m[0], x))
+#define ROW_AVX(m, x, y, z, w) _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(zero, _mm256_mul_ps(m[3], w)), \
+    _mm256_mul_ps(m[2], z)), _mm256_mul_ps(m[1], y)), _mm256_mul_ps(m[0], x))
+
+KG3_TARGET("sse2")
+static void transform_sse2(const VertexTransform& xf, const Vec3f* positions, const Vec3f* normals, int n,
+                           Vec4f* screen, Vec3f* ndc, Vec3f* nrm) {
+    const int W = 4;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    __m128 mvp[4][4], vp[4][4], nm[3][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++) {
+            mvp[r][c] = _mm_set1_ps(xf.mvp[r][c]);
+            vp[r][c] = _mm_set1_ps(xf.viewport[r][c]);
+            if (r < 3) nm[r][c] = _mm_set1_ps(xf.normal[r][c]);
+        }
+
+    int i = 0;
+    for (; i + W <= n; i += W) {
+        // AoS -> SoA
+        alignas(16) float in[6][W];
+        for (int k = 0; k < W; k++) {
+            for (int c = 0; c < 3; c++) {
+                in[c][k] = positions[i + k][c];
+                in[3 + c][k] = normals[i + k][c];
+            }
+        }
+        __m128 px = _mm_load_ps(in[0]), py = _mm_load_ps(in[1]), pz = _mm_load_ps(in[2]);
+        __m128 nx = _mm_load_ps(in[3]), ny = _mm_load_ps(in[4]), nz = _mm_load_ps(in[5]);
+
+        __m128 clip[4];
+        for (int r = 0; r < 4; r++) clip[r] = ROW_SSE(mvp[r], px, py, pz, one);
+
+        alignas(16) float out[10][W];
+        for (int r = 0; r < 4; r++) _mm_store_ps(out[r], ROW_SSE(vp[r], clip[0], clip[1], clip[2], clip[3]));
+        for (int r = 0; r < 3; r++) {
+            _mm_store_ps(out[4 + r], _mm_div_ps(clip[r], clip[3]));
+            _mm_store_ps(out[7 + r], ROW_SSE(nm[r], nx, ny, nz, zero));
+        }
+
+        // SoA -> AoS
+        for (int k = 0; k < W; k++) {
+            for (int r = 0; r < 4; r++) screen[i + k][r] = out[r][k];
+            ndc[i + k] = Vec3f(out[4][k], out[5][k], out[6][k]);
+            nrm[i + k] = Vec3f(out[7][k], out[8][k], out[9][k]);
+        }
+    }
+    transform_scalar(xf, positions + i, normals + i, n - i, screen + i, ndc + i, nrm + i);
+}
+
+KG3_TARGET("avx2")
+static void transform_avx2(const VertexTransform& xf, const Vec3f* positions, const Vec3f* normals, int n,
+                           Vec4f* screen, Vec3f* ndc, Vec3f* nrm) {
+    const int W = 8;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    __m256 mvp[4][4], vp[4][4], nm[3][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++) {
+            mvp[r][c] = _mm256_set1_ps(xf.mvp[r][c]);
+            vp[r][c] = _mm256_set1_ps(xf.viewport[r][c]);
+            if (r < 3) nm[r][c] = _mm256_set1_ps(xf.normal[r][c]);
+        }
+
+    int i = 0;
+    for (; i + W <= n; i += W) {
+        alignas(32) float in[6][W];
+        for (int k = 0; k < W; k++) {
+            for (int c = 0; c < 3; c++) {
+                in[c][k] = positions[i + k][c];
+                in[3 + c][k] = normals[i + k][c];
+            }
+        }
+        __m256 px = _mm256_load_ps(in[0]), py = _mm256_load_ps(in[1]), pz = _mm256_load_ps(in[2]);
+        __m256 nx = _mm256_load_ps(in[3]), ny = _mm256_load_ps(in[4]), nz = _mm256_load_ps(in[5]);
+
+        __m256 clip[4];
+        for (int r = 0; r < 4; r++) clip[r] = ROW_AVX(mvp[r], px, py, pz, one);
+
+        alignas(32) float out[10][W];
+        for (int r = 0; r < 4; r++) _mm256_store_ps(out[r], ROW_AVX(vp[r], clip[0], clip[1], clip[2], clip[3]));
+        for (int r = 0; r < 3; r++) {
+            _mm256_store_ps(out[4 + r], _mm256_div_ps(clip[r], clip[3]));
+            _mm256_store_ps(out[7 + r], ROW_AVX(nm[r], nx, ny, nz, zero));
+        }
+
+        for (int k = 0; k < W; k++) {
+            for (int r = 0; r < 4; r++) screen[i + k][r] = out[r][k];
+            ndc[i + k] = Vec3f(out[4][k], out[5][k], out[6][k]);
+            nrm[i + k] = Vec3f(out[7][k], out[8][k], out[9][k]);
+        }
+    }
+    transform_scalar(xf, positions + i, normals + i, n - i, screen + i, ndc + i, nrm + i);
+}
+
+#endif // KG3_X86
+
+// ======================
+//  
+// ======================
+struct VertexKernelEntry {
+    const char* name;
+    VertexKernel fn;
+};
+
+static VertexKernelEntry detect_kernel() {
+#ifdef KG3_X86
+    if (cpu_has_avx2()) return VertexKernelEntry{ "avx2", transform_avx2 };
+    if (cpu_has_sse2()) return VertexKernelEntry{ "sse2", transform_sse2 };
+#endif
+    return VertexKernelEntry{ "scalar", transform_scalar };
+}
+
+static VertexKernelEntry forced_kernel = { nullptr, nullptr };
+
+static const VertexKernelEntry& current_kernel() {
+    static const VertexKernelEntry best = detect_kernel();
+    return forced_kernel.fn ? forced_kernel : best;
+}
+
+void transform_vertices(const VertexTransform& xf, const Vec3f* positions, const Vec3f* normals, int n,
+                        Vec4f* screen, Vec3f* ndc, Vec3f* nrm) {
+    current_kernel().fn(xf, positions, normals, n, screen, ndc, nrm);
+}
+
+const char* vertex_kernel_name() {
+    return current_kernel().name;
+}
+
+bool set_vertex_kernel(const char* name) {
+    std::string s(name);
+    if (s == "auto") {
+        forced_kernel = VertexKernelEntry{ nullptr, nullptr };
+        return true;
+    }
+    if (s == "scalar") {
+        forced_kernel = VertexKernelEntry{ "scalar", transform_scalar };
+        return true;
+    }
+#ifdef KG3_X86
+    if (s == "sse2" && cpu_has_sse2()) {
+        forced_kernel = VertexKernelEntry{ "sse2", transform_sse2 };
+        return true;
+    }
+    if (s == "avx2" && cpu_has_avx2()) {
+        forced_kernel = VertexKernelEntry{ "avx2", transform_avx2 };
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,25 @@
+#ifndef __VERTEX_KERNEL_H__
+#define __VERTEX_KERNEL_H__
+
+#include "geometry.h"
+
+//   
+struct VertexTransform {
+    Matrix mvp;      // Projection * ModelView
+    Matrix viewport;
+    Matrix normal;   //  ,  (Projection * ModelView)^-T
+};
+
+//   n  ,  :
+//   clip = mvp * (p, 1), screen = viewport * clip, ndc = clip / clip.w,
+//   nrm = proj<3>(normal * (n, 0))
+// SIMD-   4/8   SoA-    
+// operator*  geometry.h,       .
+void transform_vertices(const VertexTransform& xf, const Vec3f* positions, const Vec3f* normals, int n,
+                        Vec4f* screen, Vec3f* ndc, Vec3f* nrm);
+
+//       ,   span_kernel()
+const char* vertex_kernel_name();
+bool set_vertex_kernel(const char* name); // "scalar", "sse2", "avx2"  "auto"
+
+#endif //__VERTEX_KERNEL_H__